@@ -0,0 +1,91 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "bee.h"
+
+using namespace std;
+
+/* `bee batch jobs.txt -j N`: compiles and runs every program listed in
+   jobs.txt (one path per line) on N worker threads sharing one JIT.
+   Each job's output is captured and printed as one block when it finishes */
+int batch(int argc, char **argv)
+{
+	const char* jobsPath = NULL;
+	unsigned int workers = std::thread::hardware_concurrency();
+
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			workers = atoi(argv[++i]);
+		else if (!strncmp(argv[i], "-j", 2))
+			workers = atoi(argv[i] + 2);
+		else
+			jobsPath = argv[i];
+	}
+	if (workers == 0)
+		workers = 1;
+
+	std::ifstream list(jobsPath != NULL ? jobsPath : "");
+	if (!list) {
+		std::cerr << "[\x1B[91mERROR\033[0m]: usage: bee batch jobs.txt [-j N]" << endl;
+		return 1;
+	}
+
+	std::vector<std::string> jobs;
+	for (std::string line; std::getline(list, line); ) {
+		if (!line.empty() && line[0] != '#')
+			jobs.push_back(line);
+	}
+
+	bee::Engine engine;
+	std::atomic<size_t> next(0);
+	std::atomic<int> failed(0);
+	std::mutex printing;
+
+	auto work = [&]() {
+		for (size_t job = next++; job < jobs.size(); job = next++) {
+			std::string output, error;
+			bool ok = false;
+
+			std::ifstream file(jobs[job]);
+			if (!file) {
+				error = "cannot open " + jobs[job];
+			} else {
+				std::stringstream source;
+				source << file.rdbuf();
+				std::unique_ptr<bee::Program> program = engine.compile(source.str(), error);
+				if (program != NULL) {
+					bee::capture(&output);
+					program->run();
+					bee::capture(NULL);
+					ok = true;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(printing);
+			if (ok) {
+				printf("[\x1B[94mBEE\033[0m]: %s\n", jobs[job].c_str());
+				fwrite(output.data(), 1, output.size(), stdout);
+			} else {
+				failed++;
+				printf("[\x1B[94mBEE\033[0m]: %s \x1B[91mFAILURE\033[0m\n", jobs[job].c_str());
+				std::cerr << "[\x1B[91mERROR\033[0m]: " << error << endl;
+			}
+			fflush(stdout);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned int i = 1; i < workers && i < jobs.size(); i++)
+		pool.emplace_back(work);
+	work();
+	for (std::thread& thread : pool)
+		thread.join();
+
+	return failed > 0 ? 1 : 0;
+}
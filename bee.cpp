@@ -0,0 +1,176 @@
+#include <atomic>
+#include "bee.h"
+#include "node.h"
+#include "codegen.h"
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+using namespace std;
+
+void createCoreFunctions(CodeGenContext& context);
+extern "C" void bee_flush();
+void bee_capture(std::string* capture);
+
+/* Every function compiled code may call in the runtime. Only their addresses
+   are taken here, the real signatures live with the definitions */
+#define BEE_SORT_RUNTIME(X, suffix) \
+	X(bee_sort_##suffix) X(bee_binary_search_##suffix) X(bee_partition_##suffix) X(bee_nth_element_##suffix)
+
+#define BEE_RUNTIME(X) \
+	X(bee_clock_ns) X(bee_out_of_memory) X(bee_write) X(bee_newline) X(printi) \
+	X(bee_print_int) X(bee_print_uint) X(bee_print_char) X(bee_print_bool) X(bee_print_string) \
+	X(bee_print_double) X(bee_print_fixed) X(bee_printf) X(bee_print_ints) X(bee_print_doubles) \
+	X(bee_print_intv) X(bee_print_floats) X(bee_print_bools) X(bee_print_strings) \
+	X(bee_mmap_file) X(bee_unmap) X(bee_next_line) X(bee_next_field) X(bee_parse_int) X(bee_parse_double) \
+	X(bee_hash) X(bee_equal) X(bee_map_new) X(bee_map_free_int) X(bee_map_free_string) \
+	X(bee_map_get_int) X(bee_map_get_string) X(bee_map_put_int) X(bee_map_put_string) \
+	X(bee_map_contains_int) X(bee_map_contains_string) X(bee_map_len) X(bee_map_next) \
+	BEE_SORT_RUNTIME(X, i8) BEE_SORT_RUNTIME(X, i16) BEE_SORT_RUNTIME(X, i32) BEE_SORT_RUNTIME(X, i64) \
+	BEE_SORT_RUNTIME(X, u8) BEE_SORT_RUNTIME(X, u16) BEE_SORT_RUNTIME(X, u32) BEE_SORT_RUNTIME(X, u64) \
+	BEE_SORT_RUNTIME(X, f32) BEE_SORT_RUNTIME(X, f64) BEE_SORT_RUNTIME(X, string)
+
+#define BEE_DECLARE(name) extern "C" void name();
+BEE_RUNTIME(BEE_DECLARE)
+#undef BEE_DECLARE
+
+/* Every program lives in its own JITDylib, with its own LLVMContext,
+   so programs never see each other's symbols and can be unloaded */
+class bee::Engine::Impl {
+public:
+	std::unique_ptr<orc::LLJIT> jit;
+	std::atomic<unsigned> programs;
+
+	Impl() : programs(0) { }
+	orc::JITDylib* load(const std::string& source, std::string& error);
+	void unload(orc::JITDylib* dylib);
+};
+
+orc::JITDylib* bee::Engine::Impl::load(const std::string& source, std::string& error)
+{
+	NBlock* programBlock = parseString(source, error);
+	if (programBlock == NULL)
+		return NULL;
+
+	auto llvmContext = std::make_unique<LLVMContext>();
+	CodeGenContext context(*llvmContext);
+	context.functionLinkage = GlobalValue::ExternalLinkage;
+	createCoreFunctions(context);
+	context.generateCode(*programBlock);
+	delete programBlock;
+
+	if (!context.errors.empty()) {
+		error.clear();
+		for (const std::string& message : context.errors)
+			error += (error.empty() ? "" : "\n") + message;
+		delete context.module;
+		return NULL;
+	}
+	context.module->setDataLayout(jit->getDataLayout());
+
+	auto dylib = jit->createJITDylib("program" + std::to_string(programs++));
+	if (!dylib) {
+		error = toString(dylib.takeError());
+		delete context.module;
+		return NULL;
+	}
+	dylib->addToLinkOrder(jit->getMainJITDylib());
+
+	orc::ThreadSafeModule module(std::unique_ptr<Module>(context.module), std::move(llvmContext));
+	if (Error err = jit->addIRModule(*dylib, std::move(module))) {
+		error = toString(std::move(err));
+		unload(&*dylib);
+		return NULL;
+	}
+	return &*dylib;
+}
+
+void bee::Engine::Impl::unload(orc::JITDylib* dylib)
+{
+	if (Error err = jit->getExecutionSession().removeJITDylib(*dylib))
+		consumeError(std::move(err));
+}
+
+bee::Engine::Engine() : impl(new Impl())
+{
+	InitializeNativeTarget();
+	InitializeNativeTargetAsmPrinter();
+
+	/* The default compiler shares one TargetMachine, programs compiled
+	   from different threads each need their own */
+	impl->jit = cantFail(orc::LLJITBuilder()
+		.setCompileFunctionCreator([](orc::JITTargetMachineBuilder builder)
+			-> Expected<std::unique_ptr<orc::IRCompileLayer::IRCompiler>> {
+			return std::make_unique<orc::ConcurrentIRCompiler>(std::move(builder));
+		})
+		.create());
+
+	/* The runtime is bound by address, so it resolves even when the host
+	   is linked statically or without exporting its symbols */
+	orc::MangleAndInterner mangle(impl->jit->getExecutionSession(), impl->jit->getDataLayout());
+	orc::SymbolMap runtime;
+#define BEE_DEFINE(name) \
+	runtime[mangle(#name)] = JITEvaluatedSymbol(pointerToJITTargetAddress(&name), JITSymbolFlags::Exported);
+	BEE_RUNTIME(BEE_DEFINE)
+#undef BEE_DEFINE
+	cantFail(impl->jit->getMainJITDylib().define(orc::absoluteSymbols(std::move(runtime))));
+
+	/* libc and extern C functions resolve against this process */
+	impl->jit->getMainJITDylib().addGenerator(
+		cantFail(orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+			impl->jit->getDataLayout().getGlobalPrefix())));
+}
+
+bee::Engine::~Engine() { }
+
+std::unique_ptr<bee::Program> bee::Engine::compile(const std::string& source, std::string& error)
+{
+	orc::JITDylib* dylib = impl->load(source, error);
+	if (dylib == NULL)
+		return NULL;
+	return std::unique_ptr<Program>(new Program(impl.get(), dylib));
+}
+
+bee::Program::~Program()
+{
+	engine->unload(static_cast<orc::JITDylib*>(dylib));
+}
+
+void* bee::Program::symbol(const std::string& name)
+{
+	auto sym = engine->jit->lookup(*static_cast<orc::JITDylib*>(dylib), name);
+	if (!sym) {
+		consumeError(sym.takeError());
+		return NULL;
+	}
+	return reinterpret_cast<void*>(sym->getAddress());
+}
+
+void bee::Program::run()
+{
+	void (*main)() = function<void()>("main");
+	if (main != NULL)
+		main();
+	bee_flush();
+}
+
+bool bee::Program::reload(const std::string& source, std::string& error)
+{
+	orc::JITDylib* next = engine->load(source, error);
+	if (next == NULL)
+		return false;
+	engine->unload(static_cast<orc::JITDylib*>(dylib));
+	dylib = next;
+	return true;
+}
+
+void bee::flush()
+{
+	bee_flush();
+}
+
+void bee::capture(std::string* output)
+{
+	bee_capture(output);
+}
@@ -0,0 +1,75 @@
+#ifndef BEE_H
+#define BEE_H
+
+#include <memory>
+#include <string>
+
+/* libbee: compile BEE source once and call into it from C++.
+
+	bee::Engine engine;
+	std::string error;
+	std::unique_ptr<bee::Program> program = engine.compile(source, error);
+	auto square = program->function<long long(long long)>("square");
+	long long nine = square(3);
+
+   BEE types map to C++ as int -> long long, double -> double,
+   bool -> bool, string -> const char*, and arrays to pointers.
+
+   The BEE runtime comes with libbee and is bound by address, so the host
+   needs no -rdynamic; extern functions a program declares itself must
+   still be exported by the host or a shared library it loads */
+namespace bee {
+
+class Program;
+
+/* Owns the JIT shared by every program compiled through it,
+   must outlive those programs. Safe to compile from several threads at once */
+class Engine {
+public:
+	Engine();
+	~Engine();
+
+	/* Returns NULL and sets error when the source does not compile */
+	std::unique_ptr<Program> compile(const std::string& source, std::string& error);
+
+	class Impl;
+private:
+	std::unique_ptr<Impl> impl;
+};
+
+/* A compiled program, its functions stay callable until it is destroyed */
+class Program {
+public:
+	~Program();
+
+	/* Address of a top level function, NULL if there is none by that name */
+	void* symbol(const std::string& name);
+
+	template <typename F>
+	F* function(const std::string& name) { return reinterpret_cast<F*>(symbol(name)); }
+
+	/* Runs the top level statements of the program */
+	void run();
+
+	/* Swaps in a new version of the source. On failure the old version stays
+	   loaded and error is set. Pointers from symbol() must be looked up again */
+	bool reload(const std::string& source, std::string& error);
+
+private:
+	friend class Engine;
+	Program(Engine::Impl* engine, void* dylib) : engine(engine), dylib(dylib) { }
+
+	Engine::Impl* engine;
+	void* dylib;
+};
+
+/* Writes out any output BEE code has buffered on the calling thread */
+void flush();
+
+/* Sends the calling thread's BEE output into a string instead of stdout,
+   NULL switches back. Output buffered so far is flushed to the old target */
+void capture(std::string* output);
+
+}
+
+#endif
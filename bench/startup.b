@@ -0,0 +1,3 @@
+// Cold-start probe: the first thing the program does is report the time
+extern int bee_clock_ns();
+println(bee_clock_ns());
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Cold-start benchmark: time from launching a runner to the first BEE instruction.
+# The timestamp is taken just before the runner is started, the program prints
+# bee_clock_ns() as its very first statement.
+RUNS=${RUNS:-20}
+cd "$(dirname "$0")/.."
+
+measure() {
+	total=0
+	i=0
+	while [ $i -lt $RUNS ]; do
+		start=$(date +%s%N)
+		first=$($@ bench/startup.b | grep -E '^[0-9]+$' | head -n 1)
+		total=$((total + first - start))
+		i=$((i + 1))
+	done
+	echo "$*: $((total / RUNS / 1000)) us to first instruction (mean of $RUNS runs)"
+}
+
+measure ./bee-run
+measure ./bee run
@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* The server socket: $BEE_SOCKET, else bee.sock in the user's runtime
+   directory, else a name in /tmp that carries the user's uid */
+const char* socketPath()
+{
+	static std::string path;
+	if (path.empty()) {
+		const char* socket = getenv("BEE_SOCKET");
+		const char* runtime = getenv("XDG_RUNTIME_DIR");
+		if (socket != NULL && *socket != 0)
+			path = socket;
+		else if (runtime != NULL && *runtime != 0)
+			path = std::string(runtime) + "/bee.sock";
+		else
+			path = "/tmp/bee-" + std::to_string(getuid()) + ".sock";
+	}
+	return path.c_str();
+}
+
+/* True if the other end of a connected socket runs as our user */
+bool sameUser(int fd)
+{
+	struct ucred peer;
+	socklen_t length = sizeof(peer);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 && peer.uid == getuid();
+}
+
+/* Hands a command to a running `bee serve`.
+   Our stdin/stdout/stderr are passed along with the request, so the server
+   writes straight to our terminal and files land relative to our directory.
+   Returns the command's exit status, or -1 if no server of ours is listening */
+int forward(int argc, char **argv)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socketPath(), sizeof(addr.sun_path) - 1);
+
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	/* Our terminal and directory only go to a server we started ourselves */
+	if (!sameUser(fd)) {
+		fprintf(stderr, "[\x1B[91mERROR\033[0m]: %s belongs to another user, not using it\n", socketPath());
+		close(fd);
+		return -1;
+	}
+
+	/* Request: working directory followed by the arguments, NUL separated */
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		close(fd);
+		return -1;
+	}
+	std::string request(cwd, strlen(cwd) + 1);
+	for (int i = 1; i < argc; i++)
+		request.append(argv[i], strlen(argv[i]) + 1);
+
+	unsigned int size = request.size();
+	struct iovec iov = { &size, sizeof(size) };
+
+	int fds[3] = { 0, 1, 2 };
+	char control[CMSG_SPACE(sizeof(fds))];
+	memset(control, 0, sizeof(control));
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(fd, &msg, 0) < 0 || write(fd, request.data(), size) != (ssize_t)size) {
+		close(fd);
+		return -1;
+	}
+
+	/* The server replies with a single status byte once the command is done,
+	   a closed connection without one means the command crashed */
+	unsigned char status = 1;
+	if (read(fd, &status, 1) != 1)
+		status = 1;
+	close(fd);
+	return status;
+}
+
+#ifdef STANDALONE
+int main(int argc, char **argv)
+{
+	int status = forward(argc, argv);
+	if (status < 0) {
+		fprintf(stderr, "[\x1B[91mERROR\033[0m]: no bee server listening on %s\n", socketPath());
+		return 1;
+	}
+	return status;
+}
+#endif
@@ -8,6 +8,14 @@
 
 using namespace std;
 
+extern "C" void bee_flush();
+extern "C" unsigned long long bee_hash(const char* string, unsigned long long seed);
+Value* createPrintCall(CodeGenContext& context, ExpressionList& arguments, bool newline);
+Value* createFormatCall(CodeGenContext& context, ExpressionList& arguments);
+Value* createViewCall(CodeGenContext& context, const std::string& name, ExpressionList& arguments);
+Value* createMapCall(CodeGenContext& context, const std::string& name, ExpressionList& arguments);
+Value* createSortCall(CodeGenContext& context, const std::string& name, ExpressionList& arguments);
+
 // HELPERS
 
 void printType(Value* v) {
@@ -29,6 +37,261 @@ CodeGenBlock* findLocals(std::stack<CodeGenBlock*> &blocks, std::string& name) {
 	return f;
 }
 
+/* Position of a block on the stack, 0 is the bottom */
+static size_t depthOf(std::stack<CodeGenBlock*> &blocks, CodeGenBlock* b)
+{
+	CodeGenBlock* top = blocks.top();
+	if (top == b)
+		return blocks.size() - 1;
+	blocks.pop();
+	size_t depth = depthOf(blocks, b);
+	blocks.push(top);
+	return depth;
+}
+
+/* The local just declared in the current block owns heap memory */
+void CodeGenContext::own(const std::string& name)
+{
+	CodeGenBlock *b = blocks.top();
+	b->owned.push_back(name);
+	b->lowners[name] = b;
+	b->borrowed.push_back({ b, name });
+}
+
+/* Frees what the blocks pushed since depth own, at the end of the body they
+   belong to. The names pointing at that memory go out of scope with it */
+void CodeGenContext::release(size_t depth)
+{
+	if (blocks.size() <= depth)
+		return;
+	BasicBlock *block = currentBlock();
+	Function *free = module->getFunction("free");
+	std::vector<CodeGenBlock*> above;
+	while (blocks.size() > depth) {
+		above.push_back(blocks.top());
+		blocks.pop();
+	}
+	for (CodeGenBlock *b : above) {
+		for (const std::string& name : b->owned) {
+			Value *slot = b->locals[name];
+			if (b->lsoa.count(name)) {
+				StructType *columns = cast<StructType>(cast<AllocaInst>(slot)->getAllocatedType());
+				for (unsigned int i = 0; i < columns->getNumElements(); i++) {
+					Value *indices[] = { ConstantInt::get(Type::getInt32Ty(llvmContext), 0), ConstantInt::get(Type::getInt32Ty(llvmContext), i) };
+					Value *column = GetElementPtrInst::Create(columns, slot, indices, "", block);
+					CallInst::Create(free, { new LoadInst(columns->getElementType(i), column, "", false, block) }, "", block);
+				}
+				continue;
+			}
+			if (isMapType(b->ldecls[name])) {
+				Function *release = module->getFunction(mapKeyType(b->ldecls[name]) == "string" ? "bee_map_free_string" : "bee_map_free_int");
+				CallInst::Create(release, { new LoadInst(b->ltypes[name], slot, name, false, block) }, "", block);
+				continue;
+			}
+			Value *memory = new LoadInst(llvm::PointerType::get(b->ltypes[name], 0), slot, name, false, block);
+			CallInst::Create(free, { memory }, "", block);
+		}
+		b->owned.clear();
+	}
+	for (CodeGenBlock *b : above) {
+		for (const std::pair<CodeGenBlock*, std::string>& entry : b->borrowed) {
+			entry.first->locals.erase(entry.second);
+			entry.first->ltypes.erase(entry.second);
+			entry.first->ldecls.erase(entry.second);
+			entry.first->lsoa.erase(entry.second);
+			entry.first->lowners.erase(entry.second);
+		}
+		b->borrowed.clear();
+	}
+	while (!above.empty()) {
+		blocks.push(above.back());
+		above.pop_back();
+	}
+}
+
+/* Returns the name of an LLVM type as it would be written in BEE */
+static std::string nameOfType(Type* type)
+{
+	if (type->isIntegerTy(1))
+		return "bool";
+	if (type->isIntegerTy(64))
+		return "int";
+	if (type->isIntegerTy())
+		return "i" + std::to_string(type->getIntegerBitWidth());
+	if (type->isDoubleTy())
+		return "double";
+	if (type->isFloatTy())
+		return "float";
+	if (type->isPointerTy())
+		return "string";
+	return "void";
+}
+
+bool isIntegerType(const std::string& name)
+{
+	return name == "int" || name == "i8" || name == "i16" || name == "i32" || name == "i64" || isUnsignedType(name);
+}
+
+/* Maps are written key:value, as in int:double */
+bool isMapType(const std::string& name)
+{
+	return name.find(':') != std::string::npos;
+}
+
+std::string mapKeyType(const std::string& name)
+{
+	return name.substr(0, name.find(':'));
+}
+
+std::string mapValueType(const std::string& name)
+{
+	return name.substr(name.find(':') + 1);
+}
+
+bool isUnsignedType(const std::string& name)
+{
+	return name == "u8" || name == "u16" || name == "u32" || name == "u64";
+}
+
+bool isFloatType(const std::string& name)
+{
+	return name == "double" || name == "float";
+}
+
+/* Width in bits of a numeric BEE type */
+static unsigned int bitsOf(const std::string& name)
+{
+	if (name == "float")
+		return 32;
+	if (name == "int" || name == "double")
+		return 64;
+	return atoi(name.c_str() + 1);
+}
+
+/* Number literals have no type of their own, they take the other operand's */
+static bool isLiteral(NExpression& expr)
+{
+	if (dynamic_cast<NInteger*>(&expr) || dynamic_cast<NDouble*>(&expr))
+		return true;
+	NUnaryOperator* unop = dynamic_cast<NUnaryOperator*>(&expr);
+	return unop != NULL && unop->op == MINUS && isLiteral(unop->expr);
+}
+
+/* Resolves the static BEE type of an expression without generating code for it */
+std::string CodeGenContext::typeNameOf(NExpression& expr)
+{
+	if (dynamic_cast<NInteger*>(&expr))
+		return "int";
+	if (dynamic_cast<NDouble*>(&expr))
+		return "double";
+	if (dynamic_cast<NString*>(&expr))
+		return "string";
+	if (dynamic_cast<NBool*>(&expr))
+		return "bool";
+	if (NIdentifier* ident = dynamic_cast<NIdentifier*>(&expr)) {
+		CodeGenBlock* b = findLocals(blocks, ident->name);
+		return b == NULL ? "void" : b->ldecls[ident->name];
+	}
+	if (NArrayRead* read = dynamic_cast<NArrayRead*>(&expr)) {
+		CodeGenBlock* b = findLocals(blocks, read->arr);
+		if (b == NULL)
+			return "void";
+		std::string name = b->ldecls[read->arr];
+		if (name == "view")
+			return "u8";
+		if (isMapType(name))
+			return mapValueType(name);
+		return name.substr(0, name.size() - 1);
+	}
+	if (NFieldRead* read = dynamic_cast<NFieldRead*>(&expr)) {
+		CodeGenBlock* b = findLocals(blocks, read->base);
+		if (b == NULL)
+			return "void";
+		std::string name = b->ldecls[read->base];
+		if (!name.empty() && name.back() == '~')
+			name.pop_back();
+		if (structs.find(name) == structs.end())
+			return "void";
+		CodeGenStruct* info = structs[name];
+		for (unsigned int i = 0; i < info->fields.size(); i++) {
+			if (info->fields[i] == read->field)
+				return info->ftypes[i];
+		}
+		return "void";
+	}
+	if (NArray* arr = dynamic_cast<NArray*>(&expr)) {
+		if (!arr->type.empty())
+			return arr->type + "~";
+		return arr->items.empty() ? "void~" : typeNameOf(*arr->items[0]) + "~";
+	}
+	if (NBinaryOperator* binop = dynamic_cast<NBinaryOperator*>(&expr)) {
+		switch (binop->op) {
+			case CEQ: case CNE: case CLT: case CLE: case CGT: case CGE:
+				return "bool";
+		}
+		return commonTypeOf(binop->lhs, binop->rhs);
+	}
+	if (NUnaryOperator* unop = dynamic_cast<NUnaryOperator*>(&expr))
+		return typeNameOf(unop->expr);
+	if (NAssignment* assn = dynamic_cast<NAssignment*>(&expr))
+		return typeNameOf(assn->lhs);
+	if (NMethodCall* call = dynamic_cast<NMethodCall*>(&expr)) {
+		/* nth_element returns an element of its array */
+		if (call->id.name == "nth_element" && !call->arguments.empty()) {
+			std::string name = typeNameOf(*call->arguments[0]);
+			return !name.empty() && name.back() == '~' ? name.substr(0, name.size() - 1) : "void";
+		}
+		if (signatures.find(call->id.name) != signatures.end())
+			return signatures[call->id.name][0];
+		Function *function = module->getFunction(call->id.name.c_str());
+		return function == NULL ? "void" : nameOfType(function->getReturnType());
+	}
+	return "void";
+}
+
+/* A view is a pointer and length into bytes BEE does not own, followed by
+   the mapping it came from for unmap, see fileio.cpp */
+StructType *CodeGenContext::viewType()
+{
+	StructType *type = StructType::getTypeByName(llvmContext, "view");
+	if (type == NULL) {
+		Type *bytes = llvm::PointerType::get(Type::getInt8Ty(llvmContext), 0);
+		Type *fields[] = { bytes, Type::getInt64Ty(llvmContext), bytes, Type::getInt64Ty(llvmContext) };
+		type = StructType::create(llvmContext, fields, "view");
+	}
+	return type;
+}
+
+/* Strips the quotes from a string literal and resolves its escape sequences */
+std::string unescapeString(const std::string& value)
+{
+	std::string str;
+	for (unsigned int i = 1; i < value.size() - 1; i++)
+	{
+		char n = value[i];
+		if (value[i] == '\\') {
+			switch (value[i + 1]) {
+				case 'n':
+					n = '\n';
+					i++;
+					break;
+			}
+		}
+		str.push_back(n);
+	}
+	return str;
+}
+
+/* Records a compile error, the caller decides how to report it */
+void CodeGenContext::error(const std::string& message)
+{
+	errors.push_back(line > 0 ? "line " + std::to_string(line) + ": " + message : message);
+	#if EXIT == true
+	std::cerr << "[\x1B[91mERROR\033[0m]: " << errors.back() << endl;
+	exit(-1);
+	#endif
+}
+
 /* Compile the AST into a module */
 void CodeGenContext::generateCode(NBlock& root)
 {
@@ -36,17 +299,49 @@ void CodeGenContext::generateCode(NBlock& root)
 	printf("Generating code...\n");
 	#endif
 
+	/* Target the host, so type layouts are known while generating code
+	   and the vectorizers know its vector width */
+	std::string triple = sys::getProcessTriple();
+	std::string lookupError;
+	if (const Target *target = TargetRegistry::lookupTarget(triple, lookupError)) {
+		SubtargetFeatures features;
+		StringMap<bool> hostFeatures;
+		if (sys::getHostCPUFeatures(hostFeatures)) {
+			for (auto& feature : hostFeatures)
+				features.AddFeature(feature.first(), feature.second);
+		}
+		machine.reset(target->createTargetMachine(triple, sys::getHostCPUName(), features.getString(), TargetOptions(), Reloc::PIC_));
+		module->setTargetTriple(triple);
+		module->setDataLayout(machine->createDataLayout());
+	}
+
+	/* Line tables only, enough for remarks and profiles to name BEE lines */
+	debug = new DIBuilder(*module);
+	debugFile = debug->createFile(sourceFile, ".");
+	debug->createCompileUnit(dwarf::DW_LANG_C, debugFile, "bee", OPTIMIZE, "", 0, "", DICompileUnit::LineTablesOnly);
+	module->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+
 	/* Create the top level interpreter function to call as entry */
 	vector<Type*> argTypes;
-	FunctionType *ftype = FunctionType::get(Type::getVoidTy(MyContext), makeArrayRef(argTypes), false);
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(llvmContext), makeArrayRef(argTypes), false);
 	mainFunction = Function::Create(ftype, GlobalValue::ExternalLinkage, "main", module);
-	BasicBlock *bblock = BasicBlock::Create(MyContext, "entry", mainFunction, 0);
+	BasicBlock *bblock = BasicBlock::Create(llvmContext, "entry", mainFunction, 0);
+	createSubprogram(mainFunction, root.line);
 	
 	/* Push a new variable/block context */
 	pushBlock(bblock);
 	root.codeGen(*this); /* emit bytecode for the toplevel block */
-	ReturnInst::Create(MyContext, this->currentBlock());
-	popBlock();
+	release(0);
+	ReturnInst::Create(llvmContext, this->currentBlock());
+	/* Conditionals and loops leave their continue block pushed */
+	while (!blocks.empty())
+		popBlock();
+	setLocations(mainFunction, NULL, NULL, NULL, line, 0);
+	line = 0;
+
+	debug->finalize();
+	delete debug;
+	debug = NULL;
 	
 	/* Print the bytecode in a human-readable format 
 	   to see if our program compiled properly
@@ -56,28 +351,134 @@ void CodeGenContext::generateCode(NBlock& root)
 	#endif
 	// module->dump();
 
+	if (!errors.empty())
+		return;
+
+	/* Remarks name the pass, function and BEE line and column of each decision */
+	if (!remarksFile.empty()) {
+		Expected<std::unique_ptr<ToolOutputFile>> file = setupLLVMOptimizationRemarks(llvmContext, remarksFile, remarksFilter, "yaml", false);
+		if (!file) {
+			error(toString(file.takeError()));
+			return;
+		}
+		remarks = std::move(*file);
+		remarks->keep();
+	}
+
+	/* Incremental builds optimize each function on its own, see incremental.cpp */
+	if (!incremental)
+		optimize(*module);
+}
+
+/* Runs the optimization pipeline over a module, the whole program or one function's unit */
+void CodeGenContext::optimize(Module& module)
+{
+	bool coroutines = false;
+	for (Function& function : module) {
+		if (function.getName().startswith("llvm.coro."))
+			coroutines = true;
+	}
+
 	legacy::PassManager pm;
 	
 	#if OPTIMIZE == true
-	pm.add(createPromoteMemoryToRegisterPass());
-	pm.add(createInstructionCombiningPass());
-	pm.add(createReassociatePass());
-	pm.add(createGVNPass());
-	pm.add(createCFGSimplificationPass());
+	if (!coroutines) {
+		if (machine)
+			pm.add(createTargetTransformInfoWrapperPass(machine->getTargetIRAnalysis()));
+
+		pm.add(createPromoteMemoryToRegisterPass());
+		pm.add(createSROAPass());
+
+		/* Attributes for known C library externs, then inline and infer
+		   @pure/@const style attributes bottom up through the call graph,
+		   so GVN and LICM can merge and hoist calls */
+		pm.add(createInferFunctionAttrsLegacyPass());
+		pm.add(createAlwaysInlinerLegacyPass());
+		pm.add(createFunctionInliningPass());
+		pm.add(createPostOrderFunctionAttrsLegacyPass());
+		pm.add(createReversePostOrderFunctionAttrsPass());
+
+		pm.add(createInstructionCombiningPass());
+		pm.add(createReassociatePass());
+		pm.add(createGVNPass());
+		pm.add(createCFGSimplificationPass());
+		pm.add(createLoopRotatePass());
+		pm.add(createLICMPass());
+		pm.add(createIndVarSimplifyPass());
+		pm.add(createLoopVectorizePass());
+		pm.add(createSLPVectorizerPass());
+		pm.add(createInstructionCombiningPass());
+		pm.add(createCFGSimplificationPass());
+	}
 	#endif
 
+	/* The legacy pass manager has no coroutine passes, so modules with generators
+	   take the new pass manager's default pipeline, which splits them into resume
+	   and destroy functions and elides the frames of inlined ones */
+	if (coroutines) {
+		LoopAnalysisManager lam;
+		FunctionAnalysisManager fam;
+		CGSCCAnalysisManager cgam;
+		ModuleAnalysisManager mam;
+		PassBuilder builder(machine.get());
+		builder.registerModuleAnalyses(mam);
+		builder.registerCGSCCAnalyses(cgam);
+		builder.registerFunctionAnalyses(fam);
+		builder.registerLoopAnalyses(lam);
+		builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+		#if OPTIMIZE == true
+		ModulePassManager mpm = builder.buildPerModuleDefaultPipeline(OptimizationLevel::O2);
+		#else
+		ModulePassManager mpm = builder.buildO0DefaultPipeline(OptimizationLevel::O0);
+		#endif
+		mpm.run(module, mam);
+	}
+
 	#if DEBUG == true
 	pm.add(createPrintModulePass(outs()));
 	#endif
 	
-	std::error_code ec;
-	raw_fd_ostream out("out.ll", ec, sys::fs::OF_None);
+	pm.run(module);
+}
 
-	pm.add(createPrintModulePass(out));
-	pm.run(*module);
+DISubprogram* CodeGenContext::createSubprogram(Function* function, int line)
+{
+	DISubroutineType* type = debug->createSubroutineType(debug->getOrCreateTypeArray({}));
+	DISubprogram::DISPFlags flags = DISubprogram::SPFlagDefinition;
+	if (OPTIMIZE)
+		flags |= DISubprogram::SPFlagOptimized;
+	DISubprogram* subprogram = debug->createFunction(debugFile, function->getName(), StringRef(), debugFile, line, type, line, DINode::FlagPrototyped, flags);
+	function->setSubprogram(subprogram);
+	return subprogram;
+}
 
-	out.flush();
-  	out.close();
+/* Gives the location to every instruction emitted after last in block, and in the
+   blocks after lastBlock, that has none yet. Statements nest, so by the time an
+   outer one is done its inner ones have claimed their instructions. Without a
+   block every instruction of the function that has no location gets it */
+void CodeGenContext::setLocations(Function* function, BasicBlock* block, Instruction* last, BasicBlock* lastBlock, int line, int column)
+{
+	DISubprogram* scope = function->getSubprogram();
+	if (scope == NULL)
+		return;
+	DILocation* location = DILocation::get(llvmContext, line, column, scope);
+
+	Function::iterator next = function->begin();
+	if (block != NULL) {
+		BasicBlock::iterator it = last != NULL ? std::next(last->getIterator()) : block->begin();
+		for (; it != block->end(); it++) {
+			if (!it->getDebugLoc())
+				it->setDebugLoc(location);
+		}
+		next = std::next(lastBlock->getIterator());
+	}
+	for (; next != function->end(); next++) {
+		for (Instruction& inst : *next) {
+			if (!inst.getDebugLoc())
+				inst.setDebugLoc(location);
+		}
+	}
 }
 
 /* Executes the AST by running the main function */
@@ -99,68 +500,130 @@ GenericValue CodeGenContext::runCode() {
 	}
 
 	vector<GenericValue> noargs;
+	fflush(stdout);
 	GenericValue v = ee->runFunction(mainFunction, noargs);
+	bee_flush();
 	#if DEBUG == true
 	printf("Code was run.\n");
 	#endif
 	return v;
 }
 
-/* Compiles the AST by starting at the main function */
-int CodeGenContext::compileCode() {
-	#if DEBUG == true
-	printf("Compiling code...\n");
-	#endif
-
-	auto TargetTriple = LLVMGetDefaultTargetTriple();
-
-    IntrusiveRefCntPtr<clang::DiagnosticOptions> DiagOpts = new clang::DiagnosticOptions;
-    clang::TextDiagnosticPrinter *DiagClient = new clang::TextDiagnosticPrinter(errs(), &*DiagOpts);
-    IntrusiveRefCntPtr<clang::DiagnosticIDs> DiagID(new clang::DiagnosticIDs());
-    clang::DiagnosticsEngine Diags(DiagID, &*DiagOpts, DiagClient);
-	clang::driver::Driver TheDriver("/usr/bin/clang++-15", TargetTriple, Diags);
-
-    auto args = ArrayRef<const char *>{"-c", "-x", "ir", "out.ll"};
-
-    std::unique_ptr<clang::driver::Compilation> C(TheDriver.BuildCompilation(args));
-
-    if (C && !C->containsError())
-    {
-        SmallVector<std::pair<int, const clang::driver::Command *>, 4> FailingCommands;
-        TheDriver.ExecuteCompilation(*C, FailingCommands);
-    }
-
-	#if DEBUG == true
-	printf("Code was compiled.\n");
-	#endif
-
-	return 0;
-}
-
 /* Returns an LLVM type based on the identifier */
-static Type *typeOf(const NIdentifier& type) 
+Type *typeOf(CodeGenContext& context, const std::string& name)
 {
-	if (type.name.compare("void") == 0) {
-		return Type::getVoidTy(MyContext);
+	if (name.compare("void") == 0) {
+		return Type::getVoidTy(context.llvmContext);
 	} 
-	else if (type.name.compare("int") == 0) {
-		return Type::getInt64Ty(MyContext);
+	else if (name.compare("int") == 0) {
+		return Type::getInt64Ty(context.llvmContext);
 	}
-	else if (type.name.compare("double") == 0) {
-		return Type::getDoubleTy(MyContext);
+	else if (name.compare("double") == 0) {
+		return Type::getDoubleTy(context.llvmContext);
 	}
-	else if (type.name.compare("string") == 0) {
-		return llvm::PointerType::get(Type::getInt8Ty(MyContext), 0);
+	else if (name.compare("string") == 0) {
+		return llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0);
 	}
-	else if (type.name.compare("bool") == 0) {
-		return Type::getInt1Ty(MyContext);
+	else if (name.compare("bool") == 0) {
+		return Type::getInt1Ty(context.llvmContext);
 	}
-	printf("\x1B[91mFAILURE\033[0m\n");
-	std::cerr << "[\x1B[91mERROR\033[0m]: nonexistent type " << type.name << endl;
-	#if EXIT == true
-	exit(-1);
-	#endif
-	return Type::getVoidTy(MyContext);
+	else if (name.compare("float") == 0) {
+		return Type::getFloatTy(context.llvmContext);
+	}
+	else if (name.compare("view") == 0) {
+		return context.viewType();
+	}
+	/* A map variable holds a pointer to its table, see hashmap.cpp */
+	else if (isMapType(name)) {
+		std::string key = mapKeyType(name);
+		std::string value = mapValueType(name);
+		if (key != "string" && !isIntegerType(key))
+			context.error("map keys must be integers or strings, not " + key);
+		else if (value != "string" && value != "bool" && !isIntegerType(value) && !isFloatType(value))
+			context.error("map values must be numbers, bools or strings, not " + value);
+		return llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0);
+	}
+	else if (isIntegerType(name)) {
+		return Type::getIntNTy(context.llvmContext, bitsOf(name));
+	}
+	else if (context.structs.find(name) != context.structs.end()) {
+		return context.structs[name]->type;
+	}
+	context.error("nonexistent type " + name);
+	return Type::getVoidTy(context.llvmContext);
+}
+
+static Type *typeOf(CodeGenContext& context, const NIdentifier& type)
+{
+	return typeOf(context, type.name);
+}
+
+/* The type both operands of a binary operator are converted to: floats win over
+   integers, then the wider type, then unsigned over signed at equal width.
+   As in C, integer math is done in at least 32 bits */
+std::string CodeGenContext::commonTypeOf(NExpression& lhs, NExpression& rhs)
+{
+	std::string l = typeNameOf(lhs);
+	std::string r = typeNameOf(rhs);
+	bool lnumeric = isIntegerType(l) || isFloatType(l);
+	bool rnumeric = isIntegerType(r) || isFloatType(r);
+	std::string type;
+
+	if (!lnumeric || !rnumeric)
+		return l;
+	if (l == r)
+		type = l;
+	else if (isFloatType(l) != isFloatType(r))
+		type = isFloatType(l) ? l : r;
+	else if (isLiteral(rhs) && !isLiteral(lhs))
+		type = l;
+	else if (isLiteral(lhs) && !isLiteral(rhs))
+		type = r;
+	else if (bitsOf(l) != bitsOf(r))
+		type = bitsOf(l) > bitsOf(r) ? l : r;
+	else
+		type = isUnsignedType(l) ? l : r;
+
+	if (isIntegerType(type) && bitsOf(type) < 32)
+		return "i32";
+	return type;
+}
+
+/* Converts a value between numeric BEE types. Integers are extended by the sign
+   of the source, floats become integers by truncation toward zero */
+Value* CodeGenContext::convert(Value* value, const std::string& from, const std::string& to)
+{
+	if (value == NULL || !(isIntegerType(to) || isFloatType(to) || to == "bool"))
+		return value;
+
+	Type* source = value->getType();
+	Type* target = typeOf(*this, to);
+	if (source == target)
+		return value;
+
+	Instruction::CastOps cast;
+	if (to == "bool") {
+		if (source->isFloatingPointTy())
+			return new FCmpInst(*currentBlock(), CmpInst::FCMP_UNE, value, ConstantFP::get(source, 0.0));
+		if (!source->isIntegerTy())
+			return value;
+		return new ICmpInst(*currentBlock(), CmpInst::ICMP_NE, value, ConstantInt::get(source, 0));
+	}
+	if (source->isIntegerTy() && target->isIntegerTy()) {
+		if (source->getIntegerBitWidth() > target->getIntegerBitWidth())
+			cast = Instruction::Trunc;
+		else
+			cast = isUnsignedType(from) || from == "bool" ? Instruction::ZExt : Instruction::SExt;
+	}
+	else if (source->isIntegerTy() && target->isFloatingPointTy())
+		cast = isUnsignedType(from) || from == "bool" ? Instruction::UIToFP : Instruction::SIToFP;
+	else if (source->isFloatingPointTy() && target->isIntegerTy())
+		cast = isUnsignedType(to) ? Instruction::FPToUI : Instruction::FPToSI;
+	else if (source->isFloatingPointTy() && target->isFloatingPointTy())
+		cast = source->getPrimitiveSizeInBits() > target->getPrimitiveSizeInBits() ? Instruction::FPTrunc : Instruction::FPExt;
+	else
+		return value;
+	return CastInst::Create(cast, value, target, "", currentBlock());
 }
 
 /* -- Code Generation -- */
@@ -170,7 +633,7 @@ Value* NInteger::codeGen(CodeGenContext& context)
 	#if DEBUG == true
 	std::cout << "Creating integer: " << value << endl;
 	#endif
-	return ConstantInt::get(Type::getInt64Ty(MyContext), value, true);
+	return ConstantInt::get(Type::getInt64Ty(context.llvmContext), value, true);
 }
 
 Value* NDouble::codeGen(CodeGenContext& context)
@@ -178,7 +641,15 @@ Value* NDouble::codeGen(CodeGenContext& context)
 	#if DEBUG == true
 	std::cout << "Creating double: " << value << endl;
 	#endif
-	return ConstantFP::get(Type::getDoubleTy(MyContext), value);
+	return ConstantFP::get(Type::getDoubleTy(context.llvmContext), value);
+}
+
+/* An array literal assigned to a typed array takes its element type */
+static void hintArrayType(NExpression& expr, const std::string& type)
+{
+	NArray* arr = dynamic_cast<NArray*>(&expr);
+	if (arr != NULL && !type.empty() && type.back() == '~')
+		arr->type = type.substr(0, type.size() - 1);
 }
 
 Value* NArray::codeGen(CodeGenContext& context)
@@ -187,20 +658,27 @@ Value* NArray::codeGen(CodeGenContext& context)
 	std::cout << "Creating array " << endl;
 	#endif
 	
+	/* Items take the array's declared element type, or the first item's type */
+	std::string itemName = type;
+	if (itemName.empty())
+		itemName = items.empty() ? "void" : context.typeNameOf(*items[0]);
+
 	std::vector<Value*> arr;
 	ExpressionList::const_iterator it;
 	for (it = items.begin(); it != items.end(); it++) {
-		arr.push_back((**it).codeGen(context));
+		arr.push_back(context.convert((**it).codeGen(context), context.typeNameOf(**it), itemName));
+		if (arr.back() == NULL)
+			return NULL;
 	}
 
-	auto itemType = arr.size() > 0 ? arr[0]->getType() : llvm::Type::getVoidTy(MyContext);
+	auto itemType = arr.size() > 0 ? arr[0]->getType() : llvm::Type::getVoidTy(context.llvmContext);
     auto arrType = llvm::ArrayType::get(itemType, arr.size());
 
 	AllocaInst *alloc = new AllocaInst(arrType, 0, "", context.currentBlock());
 
 	for (int i = 0; i < arr.size(); i++)
 	{
-		Value *indices[] = { ConstantInt::get(Type::getInt64Ty(MyContext), i) };
+		Value *indices[] = { ConstantInt::get(Type::getInt64Ty(context.llvmContext), i) };
 		GetElementPtrInst *getElementPtr = GetElementPtrInst::Create(itemType, alloc, indices, "", context.currentBlock());
 		auto store = new StoreInst(arr[i], static_cast<Value*>(getElementPtr), false, context.currentBlock());
 	}
@@ -208,13 +686,59 @@ Value* NArray::codeGen(CodeGenContext& context)
 	return alloc;
 }
 
+/* An index as the 64 bit integer a GEP takes, whatever number type it was written in */
+static Value* createIndex(CodeGenContext& context, NExpression& index)
+{
+	Value* position = context.convert(index.codeGen(context), context.typeNameOf(index), "int");
+	if (position != NULL && !position->getType()->isIntegerTy()) {
+		context.error("an index must be a number, not " + context.typeNameOf(index));
+		return NULL;
+	}
+	return position;
+}
+
 Value* NArrayRead::codeGen(CodeGenContext& context)
 {
 	CodeGenBlock* b = findLocals(context.blocks, arr);
 
+	if (b == NULL) {
+		context.error("undeclared array " + arr);
+		return NULL;
+	}
+	if (b->lsoa.count(arr)) {
+		context.error("@soa array " + arr + " has no whole elements, use " + arr + "[i].field");
+		return NULL;
+	}
+
+	/* Reading a key that is not in a map gives a zero value */
+	if (isMapType(b->ldecls[arr])) {
+		std::string type = b->ldecls[arr];
+		Value *map = new LoadInst(b->ltypes[arr], b->locals[arr], arr, false, context.currentBlock());
+		Value *key = createMapKey(context, type, index);
+		if (key == NULL)
+			return NULL;
+		Value *args[] = { map, key };
+		Function *get = context.module->getFunction(mapKeyType(type) == "string" ? "bee_map_get_string" : "bee_map_get_int");
+		Value *slot = CallInst::Create(get, args, "", context.currentBlock());
+		return new LoadInst(typeOf(context, mapValueType(type)), slot, "", false, context.currentBlock());
+	}
+
+	/* Indexing a view reads one byte of it */
+	if (b->ldecls[arr] == "view") {
+		Value *view = new LoadInst(context.viewType(), b->locals[arr], arr, false, context.currentBlock());
+		Value *data = ExtractValueInst::Create(view, 0, "", context.currentBlock());
+		Value *indices[] = { createIndex(context, index) };
+		if (indices[0] == NULL)
+			return NULL;
+		Value *byte = GetElementPtrInst::Create(Type::getInt8Ty(context.llvmContext), data, indices, "", context.currentBlock());
+		return new LoadInst(Type::getInt8Ty(context.llvmContext), byte, "", false, context.currentBlock());
+	}
+
 	auto array = new LoadInst(llvm::PointerType::get(b->ltypes[arr], 0), b->locals[arr], arr, false, context.currentBlock());
 
-  	Value *indices[] = { index.codeGen(context) };
+	Value *indices[] = { createIndex(context, index) };
+	if (indices[0] == NULL)
+		return NULL;
 	GetElementPtrInst *getElementPtr = GetElementPtrInst::Create(b->ltypes[arr], array, indices, "", context.currentBlock());
 
 	return new LoadInst(b->ltypes[arr], static_cast<Value*>(getElementPtr), "", false, context.currentBlock());
@@ -224,24 +748,162 @@ Value* NArrayWrite::codeGen(CodeGenContext& context)
 {
 	CodeGenBlock* b = findLocals(context.blocks, arr);
 
-	auto array = new LoadInst(llvm::PointerType::get(b->ltypes[arr], 0), b->locals[arr], arr, false, context.currentBlock());
+	if (b == NULL) {
+		context.error("undeclared array " + arr);
+		return NULL;
+	}
+	if (b->lsoa.count(arr)) {
+		context.error("@soa array " + arr + " has no whole elements, use " + arr + "[i].field");
+		return NULL;
+	}
+	if (b->ldecls[arr] == "view") {
+		context.error("view " + arr + " is read-only");
+		return NULL;
+	}
 
-  	Value *indices[] = { index.codeGen(context) };
-	GetElementPtrInst *getElementPtr = GetElementPtrInst::Create(b->ltypes[arr], array, indices, "", context.currentBlock());
+	std::string type;
+	Type* elementType;
+	Value* value;
+	Value* getElementPtr;
+	if (isMapType(b->ldecls[arr])) {
+		/* Putting a key may move every value, so the value is ready before the slot is found */
+		type = mapValueType(b->ldecls[arr]);
+		elementType = typeOf(context, type);
+		Value *map = new LoadInst(b->ltypes[arr], b->locals[arr], arr, false, context.currentBlock());
+		Value *key = createMapKey(context, b->ldecls[arr], index);
+		if (key == NULL)
+			return NULL;
+		value = context.convert(assignment.codeGen(context), context.typeNameOf(assignment), type);
+		if (value == NULL)
+			return NULL;
+		Value *args[] = { map, key };
+		Function *put = context.module->getFunction(mapKeyType(b->ldecls[arr]) == "string" ? "bee_map_put_string" : "bee_map_put_int");
+		getElementPtr = CallInst::Create(put, args, "", context.currentBlock());
+	} else {
+		auto array = new LoadInst(llvm::PointerType::get(b->ltypes[arr], 0), b->locals[arr], arr, false, context.currentBlock());
+
+		Value *indices[] = { createIndex(context, index) };
+		if (indices[0] == NULL)
+			return NULL;
+		getElementPtr = GetElementPtrInst::Create(b->ltypes[arr], array, indices, "", context.currentBlock());
+
+		type = b->ldecls[arr].substr(0, b->ldecls[arr].size() - 1);
+		elementType = b->ltypes[arr];
+		value = context.convert(assignment.codeGen(context), context.typeNameOf(assignment), type);
+		if (value == NULL)
+			return NULL;
+	}
 
+	bool fp = isFloatType(type);
 	Instruction::BinaryOps instr;
 	switch (op) {
-		case PLUSASN: 		instr = Instruction::Add; goto math;
-		case MINUSASN:	 	instr = Instruction::Sub; goto math;
-		case MULASN: 		instr = Instruction::Mul; goto math;
-		case DIVASN: 		instr = Instruction::SDiv; goto math;
+		case PLUSASN: 		instr = fp ? Instruction::FAdd : Instruction::Add; goto math;
+		case MINUSASN:	 	instr = fp ? Instruction::FSub : Instruction::Sub; goto math;
+		case MULASN: 		instr = fp ? Instruction::FMul : Instruction::Mul; goto math;
+		case DIVASN: 		instr = fp ? Instruction::FDiv : isUnsignedType(type) ? Instruction::UDiv : Instruction::SDiv; goto math;
 				
-		default: 			return new StoreInst(assignment.codeGen(context), static_cast<Value*>(getElementPtr), false, context.currentBlock());
+		default: 			return new StoreInst(value, static_cast<Value*>(getElementPtr), false, context.currentBlock());
+	}
+	return NULL;
+math:
+	Value* current = new LoadInst(elementType, static_cast<Value*>(getElementPtr), "", false, context.currentBlock());
+	return new StoreInst(BinaryOperator::Create(instr, current, value, "", context.currentBlock()),  static_cast<Value*>(getElementPtr), false, context.currentBlock());
+}
+
+/* Address of a field of a struct variable, or of element index of an array of structs.
+   @soa arrays keep one column per field, so the element is found in that column */
+static Value* fieldAddress(CodeGenContext& context, std::string& base, NExpression* index, const std::string& field, Type*& fieldType, std::string& fieldName)
+{
+	CodeGenBlock* b = findLocals(context.blocks, base);
+
+	if (b == NULL) {
+		context.error("undeclared variable " + base);
+		return NULL;
+	}
+
+	std::string name = b->ldecls[base];
+	bool array = !name.empty() && name.back() == '~';
+	if (array)
+		name.pop_back();
+	if (context.structs.find(name) == context.structs.end()) {
+		context.error(base + " is not a struct");
+		return NULL;
+	}
+	if (array != (index != NULL)) {
+		context.error(array ? "missing index for struct array " + base : base + " is not an array");
+		return NULL;
+	}
+
+	CodeGenStruct* info = context.structs[name];
+	unsigned int i = 0;
+	while (i < info->fields.size() && info->fields[i] != field)
+		i++;
+	if (i == info->fields.size()) {
+		context.error("struct " + name + " has no field " + field);
+		return NULL;
+	}
+	fieldType = info->type->getElementType(i);
+	fieldName = info->ftypes[i];
+
+	Value* zero = ConstantInt::get(Type::getInt32Ty(context.llvmContext), 0);
+	Value* member = ConstantInt::get(Type::getInt32Ty(context.llvmContext), i);
+	if (index == NULL) {
+		Value *indices[] = { zero, member };
+		return GetElementPtrInst::Create(info->type, b->locals[base], indices, field, context.currentBlock());
+	}
+
+	Value* position = createIndex(context, *index);
+	if (position == NULL)
+		return NULL;
+
+	if (b->lsoa.count(base)) {
+		Value *indices[] = { zero, member };
+		Value* column = GetElementPtrInst::Create(info->columns, b->locals[base], indices, "", context.currentBlock());
+		Value* data = new LoadInst(llvm::PointerType::get(fieldType, 0), column, base + "." + field, false, context.currentBlock());
+		Value *at[] = { position };
+		return GetElementPtrInst::Create(fieldType, data, at, "", context.currentBlock());
+	}
+
+	Value* data = new LoadInst(llvm::PointerType::get(info->type, 0), b->locals[base], base, false, context.currentBlock());
+	Value *indices[] = { position, member };
+	return GetElementPtrInst::Create(info->type, data, indices, "", context.currentBlock());
+}
+
+Value* NFieldRead::codeGen(CodeGenContext& context)
+{
+	Type* fieldType;
+	std::string fieldName;
+	Value* address = fieldAddress(context, base, index, field, fieldType, fieldName);
+	if (address == NULL)
+		return NULL;
+	return new LoadInst(fieldType, address, "", false, context.currentBlock());
+}
+
+Value* NFieldWrite::codeGen(CodeGenContext& context)
+{
+	Type* fieldType;
+	std::string fieldName;
+	Value* address = fieldAddress(context, base, index, field, fieldType, fieldName);
+	if (address == NULL)
+		return NULL;
+	Value* value = context.convert(assignment.codeGen(context), context.typeNameOf(assignment), fieldName);
+	if (value == NULL)
+		return NULL;
+
+	bool fp = isFloatType(fieldName);
+	Instruction::BinaryOps instr;
+	switch (op) {
+		case PLUSASN: 		instr = fp ? Instruction::FAdd : Instruction::Add; goto math;
+		case MINUSASN:	 	instr = fp ? Instruction::FSub : Instruction::Sub; goto math;
+		case MULASN: 		instr = fp ? Instruction::FMul : Instruction::Mul; goto math;
+		case DIVASN: 		instr = fp ? Instruction::FDiv : isUnsignedType(fieldName) ? Instruction::UDiv : Instruction::SDiv; goto math;
+
+		default: 			return new StoreInst(value, address, false, context.currentBlock());
 	}
 	return NULL;
 math:
-	Value* current = new LoadInst(b->ltypes[arr], static_cast<Value*>(getElementPtr), "", false, context.currentBlock());
-	return new StoreInst(BinaryOperator::Create(instr, current, assignment.codeGen(context), "", context.currentBlock()),  static_cast<Value*>(getElementPtr), false, context.currentBlock());
+	Value* current = new LoadInst(fieldType, address, "", false, context.currentBlock());
+	return new StoreInst(BinaryOperator::Create(instr, current, value, "", context.currentBlock()), address, false, context.currentBlock());
 }
 
 Value* NString::codeGen(CodeGenContext& context)
@@ -250,22 +912,11 @@ Value* NString::codeGen(CodeGenContext& context)
 	std::cout << "Creating string: " << value << endl;
 	#endif
 
-    auto charType = llvm::IntegerType::get(MyContext, 8);
+    auto charType = llvm::IntegerType::get(context.llvmContext, 8);
 
     std::vector<llvm::Constant *> chars;
-    for(unsigned int i = 1; i < value.size() - 1; i++)
-	{
-		char n = value[i];
-		if (value[i] == '\\') {
-			switch (value[i + 1]) {
-				case 'n':
-					n = '\n';
-					i++;
-					break;
-			}
-		}
+    for (char n : unescapeString(value))
     	chars.push_back(llvm::ConstantInt::get(charType, n));
-    }
 
     chars.push_back(llvm::ConstantInt::get(charType, 0));
 
@@ -281,7 +932,7 @@ Value* NBool::codeGen(CodeGenContext& context)
 	#if DEBUG == true
 	std::cout << "Creating bool: " << value << endl;
 	#endif
-	return ConstantInt::get(Type::getInt1Ty(MyContext), value, true);
+	return ConstantInt::get(Type::getInt1Ty(context.llvmContext), value, true);
 }
 
 Value* NIdentifier::codeGen(CodeGenContext& context)
@@ -293,32 +944,66 @@ Value* NIdentifier::codeGen(CodeGenContext& context)
 	CodeGenBlock* b = findLocals(context.blocks, name);
 	
 	if (b == NULL) {
-		printf("\x1B[91mFAILURE\033[0m\n");
-		std::cerr << "[\x1B[91mERROR\033[0m]: undeclared variable " << name << endl;
-		#if EXIT == true
-		exit(-1);
-		#endif
+		context.error("undeclared variable " + name);
+		return NULL;
+	}
+	/* Columns are not one array, so they cannot be passed, copied or returned as one */
+	if (b->lsoa.count(name)) {
+		context.error("@soa array " + name + " can only be used as " + name + "[i].field");
 		return NULL;
 	}
 
-	return new LoadInst(b->ltypes[name], b->locals[name], name, false, context.currentBlock());
+	Type *type = b->ltypes[name];
+	const std::string& decl = b->ldecls[name];
+	if (!decl.empty() && decl.back() == '~')
+		type = llvm::PointerType::get(type, 0);
+
+	return new LoadInst(type, b->locals[name], name, false, context.currentBlock());
+}
+
+/* Evaluates call arguments, converted to the parameter types of the callee */
+static bool createArguments(CodeGenContext& context, const std::string& name, ExpressionList& arguments, std::vector<Value*>& args)
+{
+	std::vector<std::string> signature;
+	if (context.signatures.find(name) != context.signatures.end())
+		signature = context.signatures[name];
+	ExpressionList::const_iterator it;
+	for (it = arguments.begin(); it != arguments.end(); it++) {
+		std::string type = args.size() + 1 < signature.size() ? signature[args.size() + 1] : "";
+		hintArrayType(**it, type);
+		args.push_back(context.convert((**it).codeGen(context), context.typeNameOf(**it), type));
+		if (args.back() == NULL)
+			return false;
+	}
+	return true;
 }
 
 Value* NMethodCall::codeGen(CodeGenContext& context)
 {
+	if (id.name == "print" || id.name == "println")
+		return createPrintCall(context, arguments, id.name == "println");
+	if (id.name == "printf")
+		return createFormatCall(context, arguments);
+	if (id.name == "contains" || (id.name == "len" && arguments.size() == 1 && isMapType(context.typeNameOf(*arguments[0]))))
+		return createMapCall(context, id.name, arguments);
+	if (id.name == "sort" || id.name == "sort_by" || id.name == "binary_search" || id.name == "partition" || id.name == "nth_element")
+		return createSortCall(context, id.name, arguments);
+	if (id.name == "mmap_file" || id.name == "unmap" || id.name == "next_line" || id.name == "next_field"
+			|| id.name == "parse_int" || id.name == "parse_double" || id.name == "len")
+		return createViewCall(context, id.name, arguments);
+
 	Function *function = context.module->getFunction(id.name.c_str());
 	if (function == NULL) {
-		printf("\x1B[91mFAILURE\033[0m\n");
-		std::cerr << "[\x1B[91mERROR\033[0m]: no such function " << id.name << endl;
-		#if EXIT == true
-		exit(-1);
-		#endif
+		context.error("no such function " + id.name);
+		return NULL;
 	}
-	std::vector<Value*> args;
-	ExpressionList::const_iterator it;
-	for (it = arguments.begin(); it != arguments.end(); it++) {
-		args.push_back((**it).codeGen(context));
+	if (context.generators.count(id.name)) {
+		context.error("generator " + id.name + " can only be iterated, use for x in " + id.name + "(...)");
+		return NULL;
 	}
+	std::vector<Value*> args;
+	if (!createArguments(context, id.name, arguments, args))
+		return NULL;
 	CallInst *call = CallInst::Create(function, makeArrayRef(args), "", context.currentBlock());
 	#if DEBUG == true
 	std::cout << "Creating method call: " << id.name << endl;
@@ -333,25 +1018,39 @@ Value* NBinaryOperator::codeGen(CodeGenContext& context)
 	#endif
 	Instruction::BinaryOps instr;
 	CmpInst::Predicate pred;
+	Value *l, *r;
+
+	/* Both sides are converted to a common type, which picks the instruction */
+	std::string type = context.commonTypeOf(lhs, rhs);
+	bool fp = isFloatType(type);
+	bool sign = !isUnsignedType(type);
 
 	switch (op) {
-		case PLUS: 		instr = Instruction::Add; goto math;
-		case MINUS: 	instr = Instruction::Sub; goto math;
-		case MUL: 		instr = Instruction::Mul; goto math;
-		case DIV: 		instr = Instruction::SDiv; goto math;
-
-		case CEQ:		pred = CmpInst::ICMP_EQ; goto comp;
-		case CNE:		pred = CmpInst::ICMP_NE; goto comp;
-		case CLT:		pred = CmpInst::ICMP_SLT; goto comp;
-		case CLE:		pred = CmpInst::ICMP_SLE; goto comp;
-		case CGT:		pred = CmpInst::ICMP_SGT; goto comp;
-		case CGE:		pred = CmpInst::ICMP_SGE; goto comp;
+		case PLUS: 		instr = fp ? Instruction::FAdd : Instruction::Add; goto math;
+		case MINUS: 	instr = fp ? Instruction::FSub : Instruction::Sub; goto math;
+		case MUL: 		instr = fp ? Instruction::FMul : Instruction::Mul; goto math;
+		case DIV: 		instr = fp ? Instruction::FDiv : sign ? Instruction::SDiv : Instruction::UDiv; goto math;
+
+		case CEQ:		pred = fp ? CmpInst::FCMP_OEQ : CmpInst::ICMP_EQ; goto comp;
+		case CNE:		pred = fp ? CmpInst::FCMP_UNE : CmpInst::ICMP_NE; goto comp;
+		case CLT:		pred = fp ? CmpInst::FCMP_OLT : sign ? CmpInst::ICMP_SLT : CmpInst::ICMP_ULT; goto comp;
+		case CLE:		pred = fp ? CmpInst::FCMP_OLE : sign ? CmpInst::ICMP_SLE : CmpInst::ICMP_ULE; goto comp;
+		case CGT:		pred = fp ? CmpInst::FCMP_OGT : sign ? CmpInst::ICMP_SGT : CmpInst::ICMP_UGT; goto comp;
+		case CGE:		pred = fp ? CmpInst::FCMP_OGE : sign ? CmpInst::ICMP_SGE : CmpInst::ICMP_UGE; goto comp;
 	}
 	return NULL;
 math:
-	return BinaryOperator::Create(instr, lhs.codeGen(context), rhs.codeGen(context), "", context.currentBlock());
+	l = context.convert(lhs.codeGen(context), context.typeNameOf(lhs), type);
+	r = context.convert(rhs.codeGen(context), context.typeNameOf(rhs), type);
+	if (l == NULL || r == NULL)
+		return NULL;
+	return BinaryOperator::Create(instr, l, r, "", context.currentBlock());
 comp:
-	return CmpInst::Create(AddrSpaceCastInst::OtherOps::ICmp, pred, lhs.codeGen(context), rhs.codeGen(context), "", context.currentBlock());
+	l = context.convert(lhs.codeGen(context), context.typeNameOf(lhs), type);
+	r = context.convert(rhs.codeGen(context), context.typeNameOf(rhs), type);
+	if (l == NULL || r == NULL)
+		return NULL;
+	return CmpInst::Create(fp ? Instruction::FCmp : Instruction::ICmp, pred, l, r, "", context.currentBlock());
 }
 
 Value* NUnaryOperator::codeGen(CodeGenContext& context)
@@ -360,17 +1059,24 @@ Value* NUnaryOperator::codeGen(CodeGenContext& context)
 	std::cout << "Creating unary operation " << op << endl;
 	#endif
 
+	Value *value = expr.codeGen(context);
+	if (value == NULL)
+		return NULL;
+
 	switch (op) {
 		case MINUS:
-			return BinaryOperator::CreateNeg(expr.codeGen(context), "", context.currentBlock());
+			if (value->getType()->isFloatingPointTy())
+				return UnaryOperator::CreateFNeg(value, "", context.currentBlock());
+			return BinaryOperator::CreateNeg(value, "", context.currentBlock());
 		case NOT:
-			return BinaryOperator::CreateNot(expr.codeGen(context), "", context.currentBlock());
+			return BinaryOperator::CreateNot(value, "", context.currentBlock());
 		default:
 			return NULL;
 	}
 }
 
-Value* NAssignment::codeGen(CodeGenContext& context)
+/* Shared by assignments and declarations with a value, which own their nodes separately */
+static Value* createAssignment(CodeGenContext& context, NIdentifier& lhs, int op, NExpression& rhs)
 {
 	#if DEBUG == true
 	std::cout << "Creating assignment for " << lhs.name << endl;
@@ -379,26 +1085,52 @@ Value* NAssignment::codeGen(CodeGenContext& context)
 	CodeGenBlock* b = findLocals(context.blocks, lhs.name);
 
 	if (b == NULL) {
-		printf("\x1B[91mFAILURE\033[0m\n");
-		std::cerr << "[\x1B[91mERROR\033[0m]: undeclared variable " << lhs.name << endl;
-		#if EXIT == true
-		exit(-1);
-		#endif
+		context.error("undeclared variable " + lhs.name);
+		return NULL;
+	}
+
+	if (std::find(b->owned.begin(), b->owned.end(), lhs.name) != b->owned.end()) {
+		context.error(lhs.name + " owns its memory and cannot be assigned");
 		return NULL;
 	}
 
+	/* A copy of a sized array or map must not outlive the block that frees it */
+	NIdentifier* source = dynamic_cast<NIdentifier*>(&rhs);
+	CodeGenBlock* from = source == NULL ? NULL : findLocals(context.blocks, source->name);
+	if (from != NULL && from->lowners.count(source->name)) {
+		CodeGenBlock* owner = from->lowners[source->name];
+		if (owner->block->getParent() != b->block->getParent() || depthOf(context.blocks, b) < depthOf(context.blocks, owner)) {
+			context.error(source->name + " is freed when its block ends, " + lhs.name + " would outlive it");
+			return NULL;
+		}
+		b->lowners[lhs.name] = owner;
+		owner->borrowed.push_back({ b, lhs.name });
+	}
+
+	std::string type = b->ldecls[lhs.name];
+	hintArrayType(rhs, type);
+	Value *value = context.convert(rhs.codeGen(context), context.typeNameOf(rhs), type);
+	if (value == NULL)
+		return NULL;
+
+	bool fp = isFloatType(type);
 	Instruction::BinaryOps instr;
 	switch (op) {
-		case PLUSASN: 		instr = Instruction::Add; goto math;
-		case MINUSASN:	 	instr = Instruction::Sub; goto math;
-		case MULASN: 		instr = Instruction::Mul; goto math;
-		case DIVASN: 		instr = Instruction::SDiv; goto math;
+		case PLUSASN: 		instr = fp ? Instruction::FAdd : Instruction::Add; goto math;
+		case MINUSASN:	 	instr = fp ? Instruction::FSub : Instruction::Sub; goto math;
+		case MULASN: 		instr = fp ? Instruction::FMul : Instruction::Mul; goto math;
+		case DIVASN: 		instr = fp ? Instruction::FDiv : isUnsignedType(type) ? Instruction::UDiv : Instruction::SDiv; goto math;
 				
-		default: 			return new StoreInst(rhs.codeGen(context), b->locals[lhs.name], false, context.currentBlock());
+		default: 			return new StoreInst(value, b->locals[lhs.name], false, context.currentBlock());
 	}
 	return NULL;
 math:
-	return new StoreInst(BinaryOperator::Create(instr, lhs.codeGen(context), rhs.codeGen(context), "", context.currentBlock()), b->locals[lhs.name], false, context.currentBlock());
+	return new StoreInst(BinaryOperator::Create(instr, lhs.codeGen(context), value, "", context.currentBlock()), b->locals[lhs.name], false, context.currentBlock());
+}
+
+Value* NAssignment::codeGen(CodeGenContext& context)
+{
+	return createAssignment(context, lhs, op, rhs);
 }
 
 Value* NBlock::codeGen(CodeGenContext& context)
@@ -410,7 +1142,14 @@ Value* NBlock::codeGen(CodeGenContext& context)
 		auto type = **it;
 		std::cout << "Generating code for " << typeid(type).name() << endl;
 		#endif
+		BasicBlock* block = context.currentBlock();
+		Instruction* before = block->empty() ? NULL : &block->back();
+		BasicBlock* lastBlock = &block->getParent()->back();
+		context.line = (**it).line;
 		last = (**it).codeGen(context);
+		if (!context.errors.empty())
+			break;
+		context.setLocations(block->getParent(), block, before, lastBlock, (**it).line, (**it).column);
 	}
 	#if DEBUG == true
 	std::cout << "Creating block" << endl;
@@ -431,7 +1170,14 @@ Value* NReturnStatement::codeGen(CodeGenContext& context)
 	#if DEBUG == true
 	std::cout << "Generating return code for " << typeid(expression).name() << endl;
 	#endif
+	if (context.generator != NULL) {
+		context.error("generators cannot return a value, they end when their body does");
+		return NULL;
+	}
 	Value *returnValue = expression.codeGen(context);
+	std::string function = context.currentBlock()->getParent()->getName().str();
+	if (context.signatures.find(function) != context.signatures.end())
+		returnValue = context.convert(returnValue, context.typeNameOf(expression), context.signatures[function][0]);
 	context.setCurrentReturnValue(returnValue);
 	return returnValue;
 }
@@ -442,78 +1188,348 @@ Value* NVariableDeclaration::codeGen(CodeGenContext& context)
 	std::cout << "Creating variable declaration " << type.name << " " << id.name << endl;
 	#endif
 	if (context.locals().find(id.name) != context.locals().end()) {
-		printf("\x1B[91mFAILURE\033[0m\n");
-		std::cerr << "[\x1B[91mERROR\033[0m]: variable already declared " << id.name << endl;
-		#if EXIT == true
-		exit(-1);
-		#endif
+		context.error("variable already declared " + id.name);
 		return NULL;
 	}
 
-	context.ltypes()[id.name] = typeOf(type);
+	context.ltypes()[id.name] = typeOf(context, type);
+	context.ldecls()[id.name] = type.name;
 	AllocaInst *alloc = new AllocaInst(context.ltypes()[id.name], 0, id.name.c_str(), context.currentBlock());
 	context.locals()[id.name] = alloc;
 
 	if (assignmentExpr != NULL) {
-		NAssignment assn(id, *assignmentExpr);
-		assn.codeGen(context);
+		createAssignment(context, id, 0, *assignmentExpr);
+	} else if (isMapType(type.name) && !context.parameters) {
+		Value* map = CallInst::Create(context.module->getFunction("bee_map_new"), "", context.currentBlock());
+		new StoreInst(map, alloc, false, context.currentBlock());
+		context.own(id.name);
+	} else if (type.name == "view" && !context.parameters) {
+		/* An unset view is empty and maps nothing, so unmap leaves it alone */
+		new StoreInst(ConstantAggregateZero::get(context.viewType()), alloc, false, context.currentBlock());
 	}
 	return alloc;
 }
 
+/* Zeroed heap memory for count elements. Running out of memory ends the
+   program, so code after the call continues in a block of its own */
+static Value* createCalloc(CodeGenContext& context, Value* count, Type* type)
+{
+	BasicBlock *block = context.currentBlock();
+	Value* args[] = { count, ConstantExpr::getSizeOf(type) };
+	Value* memory = CallInst::Create(context.module->getFunction("calloc"), args, "", block);
+
+	BasicBlock *Failed = BasicBlock::Create(context.llvmContext, "oom", block->getParent());
+	BasicBlock *Allocated = BasicBlock::Create(context.llvmContext, "allocated", block->getParent());
+	Failed->moveAfter(block);
+	Allocated->moveAfter(Failed);
+	Value* none = new ICmpInst(*block, ICmpInst::ICMP_EQ, memory, ConstantPointerNull::get(cast<PointerType>(memory->getType())), "");
+	Value* wanted = new ICmpInst(*block, ICmpInst::ICMP_NE, count, ConstantInt::get(count->getType(), 0), "");
+	BranchInst::Create(Failed, Allocated, BinaryOperator::Create(Instruction::And, none, wanted, "", block), block);
+	CallInst::Create(context.module->getFunction("bee_out_of_memory"), "", Failed);
+	new UnreachableInst(context.llvmContext, Failed);
+
+	context.blocks.top()->block = Allocated;
+	return memory;
+}
+
 Value* NArrayDeclaration::codeGen(CodeGenContext& context)
 {
 	#if DEBUG == true
 	std::cout << "Creating variable declaration " << type.name << " " << id.name << endl;
 	#endif
 	if (context.locals().find(id.name) != context.locals().end()) {
-		printf("\x1B[91mFAILURE\033[0m\n");
-		std::cerr << "[\x1B[91mERROR\033[0m]: array already declared " << id.name << endl;
-		#if EXIT == true
-		exit(-1);
-		#endif
+		context.error("array already declared " + id.name);
+		return NULL;
+	}
+
+	context.ltypes()[id.name] = typeOf(context, type);
+	context.ldecls()[id.name] = type.name + "~";
+
+	CodeGenStruct* info = NULL;
+	if (layout == "@soa") {
+		if (context.structs.find(type.name) == context.structs.end()) {
+			context.error("@soa needs a struct type, not " + type.name);
+			return NULL;
+		}
+		info = context.structs[type.name];
+		context.lsoa().insert(id.name);
+	} else if (!layout.empty() && layout != "@aos") {
+		context.error("unknown array layout " + layout);
 		return NULL;
 	}
 
-	context.ltypes()[id.name] = typeOf(type);
-	AllocaInst *alloc = new AllocaInst(llvm::PointerType::get(context.ltypes()[id.name], 0), 0, id.name.c_str(), context.currentBlock());
+	AllocaInst *alloc;
+	if (info != NULL)
+		alloc = new AllocaInst(info->columns, 0, id.name.c_str(), context.currentBlock());
+	else
+		alloc = new AllocaInst(llvm::PointerType::get(context.ltypes()[id.name], 0), 0, id.name.c_str(), context.currentBlock());
 	context.locals()[id.name] = alloc;
 
 	if (assignmentExpr != NULL) {
-		NAssignment assn(id, *assignmentExpr);
-		assn.codeGen(context);
+		createAssignment(context, id, 0, *assignmentExpr);
+	}
+
+	/* T~ name[n] allocates n zeroed elements, one column per field for @soa.
+	   The array lives until the end of the body it is declared in */
+	if (size != NULL && !context.parameters) {
+		/* calloc takes a size_t, so the count is widened to int first */
+		Value* count = context.convert(size->codeGen(context), context.typeNameOf(*size), "int");
+		if (count == NULL)
+			return NULL;
+		if (!count->getType()->isIntegerTy()) {
+			context.error("the size of " + id.name + " must be a number, not " + context.typeNameOf(*size));
+			return NULL;
+		}
+		if (info == NULL) {
+			Value* memory = createCalloc(context, count, context.ltypes()[id.name]);
+			new StoreInst(memory, alloc, false, context.currentBlock());
+		}
+		for (unsigned int i = 0; info != NULL && i < info->fields.size(); i++) {
+			Value* memory = createCalloc(context, count, info->type->getElementType(i));
+			Value *indices[] = { ConstantInt::get(Type::getInt32Ty(context.llvmContext), 0), ConstantInt::get(Type::getInt32Ty(context.llvmContext), i) };
+			Value* column = GetElementPtrInst::Create(info->columns, alloc, indices, "", context.currentBlock());
+			new StoreInst(memory, column, false, context.currentBlock());
+		}
+		context.own(id.name);
 	}
 	return alloc;
 }
 
+Value* NStructDeclaration::codeGen(CodeGenContext& context)
+{
+	#if DEBUG == true
+	std::cout << "Creating struct declaration " << id.name << endl;
+	#endif
+	if (context.structs.find(id.name) != context.structs.end()) {
+		context.error("struct already declared " + id.name);
+		return NULL;
+	}
+
+	CodeGenStruct* info = new CodeGenStruct();
+	vector<Type*> fieldTypes, columnTypes;
+	VariableList::const_iterator it;
+	for (it = fields.begin(); it != fields.end(); it++) {
+		if (dynamic_cast<NArrayDeclaration*>((Node*)*it) != NULL) {
+			context.error("struct field " + (**it).id.name + " cannot be an array");
+			delete info;
+			return NULL;
+		}
+		Type* fieldType = typeOf(context, (**it).type);
+		fieldTypes.push_back(fieldType);
+		columnTypes.push_back(llvm::PointerType::get(fieldType, 0));
+		info->fields.push_back((**it).id.name);
+		info->ftypes.push_back((**it).type.name);
+	}
+	info->type = StructType::create(context.llvmContext, fieldTypes, id.name);
+	info->columns = StructType::create(context.llvmContext, columnTypes, id.name + ".soa");
+	context.structs[id.name] = info;
+	return NULL;
+}
+
+/* Source annotations: @inline @noinline @hot @cold, and @pure (reads no
+   memory it was not given, writes none) and @const (touches no memory) */
+static bool setAttributes(CodeGenContext& context, Function* function, const vector<std::string>& attributes)
+{
+	for (const std::string& attribute : attributes) {
+		if (attribute == "@inline")
+			function->addFnAttr(Attribute::AlwaysInline);
+		else if (attribute == "@noinline")
+			function->addFnAttr(Attribute::NoInline);
+		else if (attribute == "@hot")
+			function->addFnAttr(Attribute::Hot);
+		else if (attribute == "@cold")
+			function->addFnAttr(Attribute::Cold);
+		else if (attribute == "@pure")
+			function->addFnAttr(Attribute::ReadOnly);
+		else if (attribute == "@const")
+			function->addFnAttr(Attribute::ReadNone);
+		else {
+			context.error("unknown function attribute " + attribute);
+			return false;
+		}
+		if (attribute == "@pure" || attribute == "@const") {
+			function->addFnAttr(Attribute::NoUnwind);
+			function->addFnAttr(Attribute::WillReturn);
+		}
+	}
+	if (function->hasFnAttribute(Attribute::AlwaysInline) && function->hasFnAttribute(Attribute::NoInline)) {
+		context.error("function " + function->getName().str() + " cannot be both @inline and @noinline");
+		return false;
+	}
+	/* @const already implies @pure, LLVM rejects readonly and readnone together */
+	if (function->hasFnAttribute(Attribute::ReadOnly) && function->hasFnAttribute(Attribute::ReadNone)) {
+		context.error("function " + function->getName().str() + " cannot be both @pure and @const");
+		return false;
+	}
+	return true;
+}
+
+/* Records the BEE types of a function's result and parameters, and returns
+   the LLVM parameter types. Array parameters are passed as pointers */
+static vector<Type*> createSignature(CodeGenContext& context, const NIdentifier& id, const NIdentifier& type, const VariableList& arguments)
+{
+	vector<Type*> argTypes;
+	vector<std::string> signature(1, type.name);
+	VariableList::const_iterator it;
+	for (it = arguments.begin(); it != arguments.end(); it++) {
+		bool array = dynamic_cast<NArrayDeclaration*>((Node*)*it) != NULL;
+		Type* argType = typeOf(context, (**it).type);
+		argTypes.push_back(array ? llvm::PointerType::get(argType, 0) : argType);
+		signature.push_back((**it).type.name + (array ? "~" : ""));
+	}
+	context.signatures[id.name] = signature;
+	return argTypes;
+}
+
+/* Narrow integers cross the C calling convention extended to 32 bits,
+   by their sign, as clang does for char and short */
+static void setExtensions(CodeGenContext& context, Function* function)
+{
+	const vector<std::string>& signature = context.signatures[function->getName().str()];
+	for (unsigned int i = 0; i < signature.size(); i++) {
+		const std::string& name = signature[i];
+		if (name != "bool" && !(isIntegerType(name) && bitsOf(name) < 32))
+			continue;
+		Attribute::AttrKind kind = isUnsignedType(name) || name == "bool" ? Attribute::ZExt : Attribute::SExt;
+		if (i == 0 && function->getReturnType()->isIntegerTy())
+			function->addRetAttr(kind);
+		else if (i == 0)
+			continue;
+		else
+			function->addParamAttr(i - 1, kind);
+	}
+}
+
 Value* NExternDeclaration::codeGen(CodeGenContext& context)
 {
-    vector<Type*> argTypes;
-    VariableList::const_iterator it;
-    for (it = arguments.begin(); it != arguments.end(); it++) {
-        argTypes.push_back(typeOf((**it).type));
-    }
-    FunctionType *ftype = FunctionType::get(typeOf(type), makeArrayRef(argTypes), false);
+    vector<Type*> argTypes = createSignature(context, id, type, arguments);
+    FunctionType *ftype = FunctionType::get(typeOf(context, type), makeArrayRef(argTypes), false);
     Function *function = Function::Create(ftype, GlobalValue::ExternalLinkage, id.name.c_str(), context.module);
+    setExtensions(context, function);
+    if (!setAttributes(context, function, attributes))
+        return NULL;
     return function;
 }
 
+/* True if a yield appears anywhere in the block, making its function a generator */
+static bool containsYield(NBlock& block)
+{
+	for (NStatement* statement : block.statements) {
+		if (dynamic_cast<NYieldStatement*>(statement))
+			return true;
+		if (NConditional* conditional = dynamic_cast<NConditional*>(statement)) {
+			if (containsYield(conditional->thenblock) || containsYield(conditional->elseblock))
+				return true;
+		}
+		if (NLoop* loop = dynamic_cast<NLoop*>(statement)) {
+			if (containsYield(loop->block))
+				return true;
+		}
+		if (NForIn* loop = dynamic_cast<NForIn*>(statement)) {
+			if (containsYield(loop->block))
+				return true;
+		}
+		if (NSwitch* choice = dynamic_cast<NSwitch*>(statement)) {
+			for (NSwitchCase* arm : choice->cases) {
+				if (containsYield(arm->block))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+/* A generator is a switched-resume LLVM coroutine. Calling it runs the body up to
+   the first yield and returns its handle, the for loop reads each value from the
+   promise and resumes it. The frame is heap allocated unless CoroElide can prove
+   it never outlives the loop, which it can once the generator is inlined */
+static void createGeneratorBody(CodeGenContext& context, Function* function, NBlock& block, const std::string& type)
+{
+	LLVMContext& llvmContext = context.llvmContext;
+	Module* module = context.module;
+	Type* valueType = typeOf(context, type);
+	Type* bytePointer = llvm::PointerType::get(Type::getInt8Ty(llvmContext), 0);
+	Value* none = ConstantPointerNull::get(llvm::PointerType::get(Type::getInt8Ty(llvmContext), 0));
+	Align align = module->getDataLayout().getPrefTypeAlign(valueType);
+
+	function->addFnAttr(Attribute::PresplitCoroutine);
+	BasicBlock* allocate = BasicBlock::Create(llvmContext, "coro.alloc", function);
+	BasicBlock* begin = BasicBlock::Create(llvmContext, "coro.begin", function);
+	BasicBlock* cleanup = BasicBlock::Create(llvmContext, "coro.cleanup", function);
+	BasicBlock* release = BasicBlock::Create(llvmContext, "coro.free", function);
+	BasicBlock* suspend = BasicBlock::Create(llvmContext, "coro.suspend", function);
+	BasicBlock* finished = BasicBlock::Create(llvmContext, "coro.finished", function);
+
+	Value* promise = new AllocaInst(valueType, 0, nullptr, align, "promise", context.currentBlock());
+	Value* idArgs[] = { ConstantInt::get(Type::getInt32Ty(llvmContext), align.value()), promise, none, none };
+	Value* id = CallInst::Create(Intrinsic::getDeclaration(module, Intrinsic::coro_id), idArgs, "id", context.currentBlock());
+	Value* needAlloc = CallInst::Create(Intrinsic::getDeclaration(module, Intrinsic::coro_alloc), {id}, "", context.currentBlock());
+	BranchInst::Create(allocate, begin, needAlloc, context.currentBlock());
+
+	Value* size = CallInst::Create(Intrinsic::getDeclaration(module, Intrinsic::coro_size, {Type::getInt64Ty(llvmContext)}), "", allocate);
+	Value* memory = CallInst::Create(module->getFunction("malloc"), {size}, "", allocate);
+	BranchInst::Create(begin, allocate);
+
+	PHINode* frame = PHINode::Create(bytePointer, 2, "", begin);
+	frame->addIncoming(none, context.currentBlock());
+	frame->addIncoming(memory, allocate);
+	Value* beginArgs[] = { id, frame };
+	Value* handle = CallInst::Create(Intrinsic::getDeclaration(module, Intrinsic::coro_begin), beginArgs, "handle", begin);
+
+	CodeGenGenerator generator;
+	generator.promise = promise;
+	generator.type = type;
+	generator.cleanup = cleanup;
+	generator.suspend = suspend;
+	context.generator = &generator;
+	size_t depth = context.blocks.size();
+	context.pushBlock(begin);
+	block.codeGen(context);
+	context.release(depth);
+	context.generator = NULL;
+
+	/* Falling off the end is the final suspend, the loop sees it as done */
+	Value* finalArgs[] = { ConstantTokenNone::get(llvmContext), ConstantInt::getTrue(llvmContext) };
+	Value* state = CallInst::Create(Intrinsic::getDeclaration(module, Intrinsic::coro_suspend), finalArgs, "", context.currentBlock());
+	SwitchInst* resume = SwitchInst::Create(state, suspend, 2, context.currentBlock());
+	resume->addCase(ConstantInt::get(Type::getInt8Ty(llvmContext), 0), finished);
+	resume->addCase(ConstantInt::get(Type::getInt8Ty(llvmContext), 1), cleanup);
+	new UnreachableInst(llvmContext, finished);
+
+	Value* freeArgs[] = { id, handle };
+	Value* used = CallInst::Create(Intrinsic::getDeclaration(module, Intrinsic::coro_free), freeArgs, "", cleanup);
+	Value* allocated = new ICmpInst(*cleanup, CmpInst::ICMP_NE, used, none);
+	BranchInst::Create(release, suspend, allocated, cleanup);
+	CallInst::Create(module->getFunction("free"), {used}, "", release);
+	BranchInst::Create(suspend, release);
+
+	Value* endArgs[] = { handle, ConstantInt::getFalse(llvmContext) };
+	CallInst::Create(Intrinsic::getDeclaration(module, Intrinsic::coro_end), endArgs, "", suspend);
+	ReturnInst::Create(llvmContext, handle, suspend);
+}
+
 Value* NFunctionDeclaration::codeGen(CodeGenContext& context)
 {
-	vector<Type*> argTypes;
+	vector<Type*> argTypes = createSignature(context, id, type, arguments);
 	VariableList::const_iterator it;
-	for (it = arguments.begin(); it != arguments.end(); it++) {
-		argTypes.push_back(typeOf((**it).type));
-	}
-	FunctionType *ftype = FunctionType::get(typeOf(type), makeArrayRef(argTypes), false);
-	Function *function = Function::Create(ftype, GlobalValue::InternalLinkage, id.name.c_str(), context.module);
-	BasicBlock *bblock = BasicBlock::Create(MyContext, "entry", function, 0);
+	bool generator = containsYield(block);
+	Type* resultType = generator ? llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0) : typeOf(context, type);
+	FunctionType *ftype = FunctionType::get(resultType, makeArrayRef(argTypes), false);
+	Function *function = Function::Create(ftype, context.functionLinkage, id.name.c_str(), context.module);
+	setExtensions(context, function);
+	if (!setAttributes(context, function, attributes))
+		return NULL;
+	BasicBlock *bblock = BasicBlock::Create(context.llvmContext, "entry", function, 0);
+	context.createSubprogram(function, line);
 
+	/* Conditionals and loops leave their continue block pushed, unwind to here */
+	size_t depth = context.blocks.size();
 	context.pushBlock(bblock);
 
 	Function::arg_iterator argsValues = function->arg_begin();
     Value* argumentValue;
 
+	context.parameters = true;
 	for (it = arguments.begin(); it != arguments.end(); it++) {
 		(**it).codeGen(context);
 		
@@ -521,11 +1537,20 @@ Value* NFunctionDeclaration::codeGen(CodeGenContext& context)
 		argumentValue->setName((*it)->id.name.c_str());
 		StoreInst *inst = new StoreInst(argumentValue, context.locals()[(*it)->id.name], false, bblock);
 	}
+	context.parameters = false;
 	
-	block.codeGen(context);
-	ReturnInst::Create(MyContext, context.getCurrentReturnValue(), bblock);
+	if (generator) {
+		context.generators.insert(id.name);
+		createGeneratorBody(context, function, block, type.name);
+	} else {
+		block.codeGen(context);
+		context.release(depth);
+		ReturnInst::Create(context.llvmContext, context.getCurrentReturnValue(), context.currentBlock());
+	}
 
-	context.popBlock();
+	while (context.blocks.size() > depth)
+		context.popBlock();
+	context.setLocations(function, NULL, NULL, NULL, line, column);
 	#if DEBUG == true
 	std::cout << "Creating function: " << id.name << endl;
 	#endif
@@ -534,19 +1559,26 @@ Value* NFunctionDeclaration::codeGen(CodeGenContext& context)
 
 Value* NConditional::codeGen(CodeGenContext& context)
 {
-	BasicBlock *Then = BasicBlock::Create(MyContext, "then", context.currentBlock()->getParent());
-	BasicBlock *Else = BasicBlock::Create(MyContext, "else", context.currentBlock()->getParent());
-	BasicBlock *Continue = BasicBlock::Create(MyContext, "continue", context.currentBlock()->getParent());
+	BasicBlock *Then = BasicBlock::Create(context.llvmContext, "then", context.currentBlock()->getParent());
+	BasicBlock *Else = BasicBlock::Create(context.llvmContext, "else", context.currentBlock()->getParent());
+	BasicBlock *Continue = BasicBlock::Create(context.llvmContext, "continue", context.currentBlock()->getParent());
 
-	BranchInst::Create(Then, Else, condition.codeGen(context), context.currentBlock());
+	Value *cond = condition.codeGen(context);
+	if (cond == NULL)
+		return NULL;
+	BranchInst::Create(Then, Else, cond, context.currentBlock());
 
+	size_t depth = context.blocks.size();
 	context.pushBlock(Then);
 	thenblock.codeGen(context);
+	context.release(depth);
 	BranchInst::Create(Continue, context.currentBlock());
 
 	Else->moveAfter(context.currentBlock());
+	depth = context.blocks.size();
 	context.pushBlock(Else);
 	elseblock.codeGen(context);
+	context.release(depth);
 	BranchInst::Create(Continue, context.currentBlock());
 
 	Continue->moveAfter(context.currentBlock());
@@ -557,17 +1589,322 @@ Value* NConditional::codeGen(CodeGenContext& context)
 
 Value* NLoop::codeGen(CodeGenContext& context)
 {
-	BasicBlock *Loop = BasicBlock::Create(MyContext, "loop", context.currentBlock()->getParent());
-	BasicBlock *Continue = BasicBlock::Create(MyContext, "continue", context.currentBlock()->getParent());
+	BasicBlock *Loop = BasicBlock::Create(context.llvmContext, "loop", context.currentBlock()->getParent());
+	BasicBlock *Continue = BasicBlock::Create(context.llvmContext, "continue", context.currentBlock()->getParent());
 
-	BranchInst::Create(Loop, Continue, condition.codeGen(context), context.currentBlock());
+	Value *cond = condition.codeGen(context);
+	if (cond == NULL)
+		return NULL;
+	BranchInst::Create(Loop, Continue, cond, context.currentBlock());
 
+	size_t depth = context.blocks.size();
 	context.pushBlock(Loop);
 	block.codeGen(context);
+	context.release(depth);
 	BranchInst::Create(Loop, Continue, condition.codeGen(context), context.currentBlock());
 
 	Continue->moveAfter(context.currentBlock());
 	context.pushBlock(Continue);
 
 	return NULL;
-}
\ No newline at end of file
+}
+
+Value* NYieldStatement::codeGen(CodeGenContext& context)
+{
+	CodeGenGenerator* generator = context.generator;
+	if (generator == NULL) {
+		context.error("yield outside of a generator");
+		return NULL;
+	}
+
+	Value* value = context.convert(expression.codeGen(context), context.typeNameOf(expression), generator->type);
+	if (value == NULL)
+		return NULL;
+	new StoreInst(value, generator->promise, false, context.currentBlock());
+
+	Value* args[] = { ConstantTokenNone::get(context.llvmContext), ConstantInt::getFalse(context.llvmContext) };
+	Value* state = CallInst::Create(Intrinsic::getDeclaration(context.module, Intrinsic::coro_suspend), args, "", context.currentBlock());
+
+	BasicBlock *Resume = BasicBlock::Create(context.llvmContext, "resume", context.currentBlock()->getParent());
+	SwitchInst* resume = SwitchInst::Create(state, generator->suspend, 2, context.currentBlock());
+	resume->addCase(ConstantInt::get(Type::getInt8Ty(context.llvmContext), 0), Resume);
+	resume->addCase(ConstantInt::get(Type::getInt8Ty(context.llvmContext), 1), generator->cleanup);
+
+	context.pushBlock(Resume);
+	return NULL;
+}
+
+/* for key in map visits every key once, in no particular order. The runtime hands
+   keys back as 8 bytes, an integer or a string pointer, converted to the key type */
+static Value* createMapLoop(CodeGenContext& context, NIdentifier& id, NIdentifier& map, NBlock& block)
+{
+	std::string keyType = mapKeyType(context.typeNameOf(map));
+	Type* intType = Type::getInt64Ty(context.llvmContext);
+	Type* valueType = typeOf(context, keyType);
+	Value* table = map.codeGen(context);
+	if (table == NULL)
+		return NULL;
+	AllocaInst* cursor = new AllocaInst(intType, 0, "cursor", context.currentBlock());
+	new StoreInst(ConstantInt::get(intType, 0), cursor, false, context.currentBlock());
+	AllocaInst* bits = new AllocaInst(intType, 0, "", context.currentBlock());
+	AllocaInst* alloc = new AllocaInst(valueType, 0, id.name.c_str(), context.currentBlock());
+
+	BasicBlock *Next = BasicBlock::Create(context.llvmContext, "next", context.currentBlock()->getParent());
+	BasicBlock *Loop = BasicBlock::Create(context.llvmContext, "loop", context.currentBlock()->getParent());
+	BasicBlock *Continue = BasicBlock::Create(context.llvmContext, "continue", context.currentBlock()->getParent());
+	BranchInst::Create(Next, context.currentBlock());
+
+	Value* args[] = { table, cursor, bits };
+	Value* more = CallInst::Create(context.module->getFunction("bee_map_next"), args, "", Next);
+	BranchInst::Create(Loop, Continue, more, Next);
+
+	size_t depth = context.blocks.size();
+	context.pushBlock(Loop);
+	context.locals()[id.name] = alloc;
+	context.ltypes()[id.name] = valueType;
+	context.ldecls()[id.name] = keyType;
+	Value* key;
+	if (keyType == "string")
+		key = new LoadInst(valueType, bits, "", false, Loop);
+	else
+		key = context.convert(new LoadInst(intType, bits, "", false, Loop), "int", keyType);
+	new StoreInst(key, alloc, false, Loop);
+	block.codeGen(context);
+	context.release(depth);
+	BranchInst::Create(Next, context.currentBlock());
+
+	Continue->moveAfter(context.currentBlock());
+	context.pushBlock(Continue);
+
+	return NULL;
+}
+
+Value* NForIn::codeGen(CodeGenContext& context)
+{
+	NIdentifier* ident = dynamic_cast<NIdentifier*>(&generator);
+	if (ident != NULL && isMapType(context.typeNameOf(*ident)))
+		return createMapLoop(context, id, *ident, block);
+
+	NMethodCall* call = dynamic_cast<NMethodCall*>(&generator);
+	if (call == NULL || !context.generators.count(call->id.name)) {
+		context.error("for " + id.name + " in needs a generator call or a map");
+		return NULL;
+	}
+
+	std::vector<Value*> args;
+	if (!createArguments(context, call->id.name, call->arguments, args))
+		return NULL;
+	Value* handle = CallInst::Create(context.module->getFunction(call->id.name), args, "", context.currentBlock());
+
+	std::string type = context.signatures[call->id.name][0];
+	Type* valueType = typeOf(context, type);
+	Align align = context.module->getDataLayout().getPrefTypeAlign(valueType);
+	Value* promiseArgs[] = { handle, ConstantInt::get(Type::getInt32Ty(context.llvmContext), align.value()), ConstantInt::getFalse(context.llvmContext) };
+	Value* promise = CallInst::Create(Intrinsic::getDeclaration(context.module, Intrinsic::coro_promise), promiseArgs, "", context.currentBlock());
+	AllocaInst* alloc = new AllocaInst(valueType, 0, id.name.c_str(), context.currentBlock());
+
+	BasicBlock *Next = BasicBlock::Create(context.llvmContext, "next", context.currentBlock()->getParent());
+	BasicBlock *Loop = BasicBlock::Create(context.llvmContext, "loop", context.currentBlock()->getParent());
+	BasicBlock *Continue = BasicBlock::Create(context.llvmContext, "continue", context.currentBlock()->getParent());
+	BranchInst::Create(Next, context.currentBlock());
+
+	Value* done = CallInst::Create(Intrinsic::getDeclaration(context.module, Intrinsic::coro_done), {handle}, "", Next);
+	BranchInst::Create(Continue, Loop, done, Next);
+
+	size_t depth = context.blocks.size();
+	context.pushBlock(Loop);
+	context.locals()[id.name] = alloc;
+	context.ltypes()[id.name] = valueType;
+	context.ldecls()[id.name] = type;
+	new StoreInst(new LoadInst(valueType, promise, "", false, Loop), alloc, false, Loop);
+	block.codeGen(context);
+	context.release(depth);
+	CallInst::Create(Intrinsic::getDeclaration(context.module, Intrinsic::coro_resume), {handle}, "", context.currentBlock());
+	BranchInst::Create(Next, context.currentBlock());
+
+	Continue->moveAfter(context.currentBlock());
+	context.pushBlock(Continue);
+	CallInst::Create(Intrinsic::getDeclaration(context.module, Intrinsic::coro_destroy), {handle}, "", Continue);
+
+	return NULL;
+}
+
+/* Integer literal case values, negative ones included */
+static bool caseValue(NExpression& expr, long long& value)
+{
+	if (NInteger* integer = dynamic_cast<NInteger*>(&expr)) {
+		value = integer->value;
+		return true;
+	}
+	NUnaryOperator* unop = dynamic_cast<NUnaryOperator*>(&expr);
+	if (unop != NULL && unop->op == MINUS && caseValue(unop->expr, value)) {
+		value = -value;
+		return true;
+	}
+	return false;
+}
+
+/* Whether a case value can be held by the switch's integer type */
+static bool caseFits(long long number, const std::string& type, unsigned int bits)
+{
+	if (isUnsignedType(type))
+		return number >= 0 && (bits >= 64 || number < (1LL << bits));
+	return bits >= 64 || (number >= -(1LL << (bits - 1)) && number < (1LL << (bits - 1)));
+}
+
+/* Finds a seed that sends every key to its own slot of a power of two table.
+   Tables grow until collisions get unlikely, so a few hundred seeds suffice */
+static bool perfectHash(const std::vector<std::string>& keys, unsigned long long& seed, unsigned long long& mask)
+{
+	unsigned long long size = 1;
+	while (size < keys.size())
+		size <<= 1;
+	for (; size <= 64 * keys.size(); size <<= 1) {
+		mask = size - 1;
+		for (seed = 0; seed < 1024; seed++) {
+			std::set<unsigned long long> slots;
+			for (const std::string& key : keys) {
+				if (!slots.insert(bee_hash(key.c_str(), seed) & mask).second)
+					break;
+			}
+			if (slots.size() == keys.size())
+				return true;
+		}
+	}
+	return false;
+}
+
+/* Integer switches become one SwitchInst, which the backend turns into a jump
+   table or a binary search. String switches hash the subject with a seed
+   picked at compile time so no two cases share a slot, switch on the slot,
+   and confirm the one candidate with a single string compare */
+Value* NSwitch::codeGen(CodeGenContext& context)
+{
+	std::string type = context.typeNameOf(value);
+	bool strings = type == "string";
+	if (!strings && !isIntegerType(type)) {
+		context.error("switch needs an integer or string value, not " + type);
+		return NULL;
+	}
+	Value* subject = value.codeGen(context);
+	if (subject == NULL)
+		return NULL;
+
+	Function* function = context.currentBlock()->getParent();
+	std::vector<BasicBlock*> arms;
+	BasicBlock* Default = NULL;
+	for (NSwitchCase* arm : cases) {
+		arms.push_back(BasicBlock::Create(context.llvmContext, arm->values.empty() ? "default" : "case", function));
+		if (arm->values.empty()) {
+			if (Default != NULL) {
+				context.error("switch has more than one default");
+				return NULL;
+			}
+			Default = arms.back();
+		}
+	}
+	BasicBlock* Continue = BasicBlock::Create(context.llvmContext, "continue", function);
+	if (Default == NULL)
+		Default = Continue;
+
+	if (strings) {
+		std::vector<std::string> keys;
+		std::set<std::string> unique;
+		std::vector<NExpression*> literals;
+		std::vector<BasicBlock*> targets;
+		for (size_t i = 0; i < cases.size(); i++) {
+			for (NExpression* expr : cases[i]->values) {
+				NString* literal = dynamic_cast<NString*>(expr);
+				if (literal == NULL) {
+					context.error("case values of a string switch must be string literals");
+					return NULL;
+				}
+				/* Hashing and comparing both stop at a NUL, so keys do too */
+				std::string key = unescapeString(literal->value).c_str();
+				if (!unique.insert(key).second) {
+					context.error("duplicate case \"" + key + "\"");
+					return NULL;
+				}
+				keys.push_back(key);
+				literals.push_back(expr);
+				targets.push_back(arms[i]);
+			}
+		}
+
+		/* With only a default arm every string goes there, there is nothing to hash */
+		unsigned long long seed, mask;
+		if (keys.empty()) {
+			BranchInst::Create(Default, context.currentBlock());
+		} else if (!perfectHash(keys, seed, mask)) {
+			context.error("no perfect hash found for the cases of this switch");
+			return NULL;
+		} else {
+			IntegerType* intType = Type::getInt64Ty(context.llvmContext);
+			Value* args[] = { subject, ConstantInt::get(intType, seed) };
+			Value* hash = CallInst::Create(context.module->getFunction("bee_hash"), args, "hash", context.currentBlock());
+			Value* slot = BinaryOperator::Create(Instruction::And, hash, ConstantInt::get(intType, mask), "slot", context.currentBlock());
+			SwitchInst* dispatch = SwitchInst::Create(slot, Default, keys.size(), context.currentBlock());
+
+			for (size_t i = 0; i < keys.size(); i++) {
+				BasicBlock* check = BasicBlock::Create(context.llvmContext, "check", function, arms.front());
+				dispatch->addCase(ConstantInt::get(intType, bee_hash(keys[i].c_str(), seed) & mask), check);
+				Value* compare[] = { subject, literals[i]->codeGen(context) };
+				Value* equal = CallInst::Create(context.module->getFunction("bee_equal"), compare, "", check);
+				BranchInst::Create(targets[i], Default, equal, check);
+			}
+		}
+	} else {
+		IntegerType* intType = cast<IntegerType>(subject->getType());
+		SwitchInst* dispatch = SwitchInst::Create(subject, Default, cases.size(), context.currentBlock());
+		std::set<ConstantInt*> seen;
+		for (size_t i = 0; i < cases.size(); i++) {
+			for (NExpression* expr : cases[i]->values) {
+				long long number;
+				if (!caseValue(*expr, number)) {
+					context.error("case values of an integer switch must be integer literals");
+					return NULL;
+				}
+				if (!caseFits(number, type, intType->getBitWidth())) {
+					context.error("case " + std::to_string(number) + " is out of range for " + type);
+					return NULL;
+				}
+				/* Constants are uniqued, so equal values are the same constant */
+				ConstantInt* constant = ConstantInt::get(intType, number, true);
+				if (!seen.insert(constant).second) {
+					context.error("duplicate case " + std::to_string(number));
+					return NULL;
+				}
+				dispatch->addCase(constant, arms[i]);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < cases.size(); i++) {
+		arms[i]->moveAfter(context.currentBlock());
+		size_t depth = context.blocks.size();
+		context.pushBlock(arms[i]);
+		cases[i]->block.codeGen(context);
+		context.release(depth);
+		BranchInst::Create(Continue, context.currentBlock());
+	}
+
+	Continue->moveAfter(context.currentBlock());
+	context.pushBlock(Continue);
+
+	return NULL;
+}
+
+/* Map keys reach the runtime as an int or a string, see hashmap.cpp */
+Value* createMapKey(CodeGenContext& context, const std::string& type, NExpression& key)
+{
+	std::string keyType = mapKeyType(type);
+	std::string from = context.typeNameOf(key);
+	if ((keyType == "string") != (from == "string")) {
+		context.error("map " + type + " needs " + keyType + " keys, not " + from);
+		return NULL;
+	}
+	Value* value = key.codeGen(context);
+	if (keyType == "string")
+		return value;
+	return context.convert(context.convert(value, from, keyType), keyType, "int");
+}
@@ -1,4 +1,5 @@
 #include <stack>
+#include <set>
 #include <typeinfo>
 #include <llvm/Pass.h>
 #include <llvm/IR/Module.h>
@@ -10,31 +11,40 @@
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/CallingConv.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/LLVMRemarkStreamer.h>
 #include <llvm/IR/IRPrintingPasses.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/MC/SubtargetFeature.h>
 #include <llvm/MC/TargetRegistry.h>
 #include <llvm/Bitstream/BitstreamReader.h>
 #include <llvm/Bitstream/BitstreamWriter.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/IPO/FunctionAttrs.h>
+#include <llvm/Transforms/IPO/InferFunctionAttrs.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/GVN.h>
 #include <llvm/Transforms/Utils.h>
-
-#include <llvm/Support/VirtualFileSystem.h>
-#include <clang/Driver/Driver.h>
-#include <clang/Driver/Compilation.h>
-#include <clang/Frontend/TextDiagnosticPrinter.h>
+#include <llvm/Transforms/Vectorize.h>
 
 using namespace llvm;
 
 class NBlock;
-
-static LLVMContext MyContext;
+class NExpression;
 
 class CodeGenBlock {
 public:
@@ -42,6 +52,34 @@ public:
     Value *returnValue;
     std::map<std::string, Value*> locals;
     std::map<std::string, Type*> ltypes;
+    std::map<std::string, std::string> ldecls;
+    std::set<std::string> lsoa;
+    /* Sized arrays and new maps declared here, freed when the body they are declared in ends */
+    std::vector<std::string> owned;
+    /* The block owning the memory a local points at, and every local pointing
+       at what this block owns. Those names go out of scope when it is freed */
+    std::map<std::string, CodeGenBlock*> lowners;
+    std::vector<std::pair<CodeGenBlock*, std::string>> borrowed;
+};
+
+/* A struct type. Arrays of it are laid out either as one array of
+   structs, or as a struct of column pointers (SoA), one per field */
+class CodeGenStruct {
+public:
+    StructType *type;
+    StructType *columns;
+    std::vector<std::string> fields;
+    std::vector<std::string> ftypes;
+};
+
+/* The coroutine a generator body is being emitted into. Each yield stores
+   into the promise, then suspends to either resume or clean up */
+class CodeGenGenerator {
+public:
+    Value *promise;
+    std::string type;
+    BasicBlock *cleanup;
+    BasicBlock *suspend;
 };
 
 class CodeGenContext {
@@ -50,20 +88,73 @@ class CodeGenContext {
 public:
 
     std::stack<CodeGenBlock *> blocks;
+    LLVMContext& llvmContext;
     Module *module;
+    std::vector<std::string> errors;
+    std::map<std::string, CodeGenStruct*> structs;
+    /* BEE type names of each function's result and parameters, LLVM types carry no sign */
+    std::map<std::string, std::vector<std::string>> signatures;
+    std::set<std::string> generators;
+    CodeGenGenerator *generator = NULL;
+    /* Set while a function's parameters are declared, they get their values from the caller */
+    bool parameters = false;
+    /* Embedders look functions up by name, so they need them exported */
+    GlobalValue::LinkageTypes functionLinkage = GlobalValue::InternalLinkage;
+
+    /* Line tables map the IR back to BEE source, for remarks, profilers and debuggers */
+    std::string sourceFile = "<source>";
+    DIBuilder *debug = NULL;
+    DIFile *debugFile = NULL;
+    int line = 0;
+    /* --remarks=file.yaml writes optimization remarks from passes matching remarksFilter */
+    std::string remarksFile;
+    std::string remarksFilter;
+    std::unique_ptr<ToolOutputFile> remarks;
+    /* The host, set up by generateCode */
+    std::unique_ptr<TargetMachine> machine;
+    /* `bee build --incremental` leaves the module unoptimized, compileIncremental
+       optimizes and caches each function's object on its own */
+    bool incremental = false;
 
-    CodeGenContext() { 
-        module = new Module("main", MyContext);
+    CodeGenContext(LLVMContext& llvmContext) : llvmContext(llvmContext) { 
+        module = new Module("main", llvmContext);
+    }
+    ~CodeGenContext() {
+        for (auto& entry : structs)
+            delete entry.second;
     }
     
+    void error(const std::string& message);
     void generateCode(NBlock& root);
+    DISubprogram* createSubprogram(Function* function, int line);
+    void setLocations(Function* function, BasicBlock* block, Instruction* last, BasicBlock* lastBlock, int line, int column);
     GenericValue runCode();
     int compileCode();
+    int compileIncremental(const std::string& cache, int& total);
+    void optimize(Module& module);
     std::map<std::string, Value*>& locals() { return blocks.top()->locals; }
     std::map<std::string, Type*>& ltypes() { return blocks.top()->ltypes; }
+    std::map<std::string, std::string>& ldecls() { return blocks.top()->ldecls; }
+    std::set<std::string>& lsoa() { return blocks.top()->lsoa; }
+    std::string typeNameOf(NExpression& expr);
+    StructType *viewType();
+    std::string commonTypeOf(NExpression& lhs, NExpression& rhs);
+    Value* convert(Value* value, const std::string& from, const std::string& to);
     BasicBlock *currentBlock() { return blocks.top()->block; }
     void pushBlock(BasicBlock *block) { blocks.push(new CodeGenBlock()); blocks.top()->returnValue = NULL; blocks.top()->block = block; }
     void popBlock() { CodeGenBlock *top = blocks.top(); blocks.pop(); delete top; }
+    void own(const std::string& name);
+    void release(size_t depth);
     void setCurrentReturnValue(Value *value) { blocks.top()->returnValue = value; }
     Value* getCurrentReturnValue() { return blocks.top()->returnValue; }
 };
+
+std::string unescapeString(const std::string& value);
+bool isIntegerType(const std::string& name);
+bool isUnsignedType(const std::string& name);
+bool isFloatType(const std::string& name);
+bool isMapType(const std::string& name);
+std::string mapKeyType(const std::string& name);
+std::string mapValueType(const std::string& name);
+Value* createMapKey(CodeGenContext& context, const std::string& type, NExpression& key);
+Type* typeOf(CodeGenContext& context, const std::string& name);
@@ -0,0 +1,56 @@
+#include "node.h"
+#include "codegen.h"
+
+#include <llvm-c/TargetMachine.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <clang/Driver/Driver.h>
+#include <clang/Driver/Compilation.h>
+#include <clang/Frontend/TextDiagnosticPrinter.h>
+
+using namespace std;
+
+/* Runs the clang driver, args are a command line like argv, minus the NULL */
+int runClang(const std::vector<const char*>& args)
+{
+	auto TargetTriple = LLVMGetDefaultTargetTriple();
+
+    IntrusiveRefCntPtr<clang::DiagnosticOptions> DiagOpts = new clang::DiagnosticOptions;
+    clang::TextDiagnosticPrinter *DiagClient = new clang::TextDiagnosticPrinter(errs(), &*DiagOpts);
+    IntrusiveRefCntPtr<clang::DiagnosticIDs> DiagID(new clang::DiagnosticIDs());
+    clang::DiagnosticsEngine Diags(DiagID, &*DiagOpts, DiagClient);
+	clang::driver::Driver TheDriver("/usr/bin/clang++-15", TargetTriple, Diags);
+
+    std::unique_ptr<clang::driver::Compilation> C(TheDriver.BuildCompilation(args));
+
+    int result = 1;
+    if (C && !C->containsError())
+    {
+        SmallVector<std::pair<int, const clang::driver::Command *>, 4> FailingCommands;
+        result = TheDriver.ExecuteCompilation(*C, FailingCommands);
+    }
+    return result;
+}
+
+/* Compiles the AST by starting at the main function */
+int CodeGenContext::compileCode() {
+	#if DEBUG == true
+	printf("Compiling code...\n");
+	#endif
+
+	std::error_code ec;
+	raw_fd_ostream out("out.ll", ec, sys::fs::OF_None);
+	module->print(out, nullptr);
+	out.close();
+
+	/* out.o is linked with libbee-rt.a by whoever uses it, see the README */
+	if (runClang({"clang++", "-c", "-x", "ir", "out.ll"}) != 0) {
+		error("compiling out.o failed");
+		return 1;
+	}
+
+	#if DEBUG == true
+	printf("Code was compiled.\n");
+	#endif
+
+	return 0;
+}
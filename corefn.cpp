@@ -4,76 +4,813 @@
 
 using namespace std;
 
-extern int yyparse();
-extern NBlock* programBlock;
-
-
-llvm::Function* createPrintfFunction(CodeGenContext& context)
+llvm::Function* createRuntimeFunction(CodeGenContext& context, const char* name,
+        llvm::Type* result, std::vector<llvm::Type*> arg_types, bool varargs = false)
 {
-    std::vector<llvm::Type*> arg_types;
-    arg_types.push_back(llvm::PointerType::get(Type::getInt8Ty(MyContext), 0)); //char*
-
-    //std::cout << "printf" << std::endl;
-
-    llvm::FunctionType* printf_type =
-        llvm::FunctionType::get(
-            llvm::Type::getInt32Ty(MyContext), arg_types, true);
+    llvm::FunctionType* func_type =
+        llvm::FunctionType::get(result, arg_types, varargs);
 
     llvm::Function *func = llvm::Function::Create(
-                printf_type, llvm::Function::ExternalLinkage,
-                llvm::Twine("printf"),
+                func_type, llvm::Function::ExternalLinkage,
+                llvm::Twine(name),
                 context.module
            );
     func->setCallingConv(llvm::CallingConv::C);
     return func;
 }
 
-void createPrintFunction(CodeGenContext& context, llvm::Function* printfFn)
+/* Declares the buffered output builtins implemented in native.cpp */
+void createOutputFunctions(CodeGenContext& context)
 {
-    std::vector<llvm::Type*> echo_arg_types;
-    echo_arg_types.push_back(llvm::Type::getInt64Ty(MyContext));
+    llvm::Type* voidType = llvm::Type::getVoidTy(context.llvmContext);
+    llvm::Type* intType = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type* doubleType = llvm::Type::getDoubleTy(context.llvmContext);
+    llvm::Type* boolType = llvm::Type::getInt1Ty(context.llvmContext);
+    llvm::Type* stringType = llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0); //char*
+    llvm::Type* countType = llvm::Type::getInt32Ty(context.llvmContext); // bytes written, as printf returns
 
-    llvm::FunctionType* echo_type =
-        llvm::FunctionType::get(
-            llvm::Type::getVoidTy(MyContext), echo_arg_types, false);
+    createRuntimeFunction(context, "bee_printf", countType, {stringType}, true);
+    createRuntimeFunction(context, "bee_write", voidType, {stringType, intType});
+    createRuntimeFunction(context, "bee_newline", voidType, {});
+    createRuntimeFunction(context, "bee_print_int", countType, {intType});
+    createRuntimeFunction(context, "bee_print_uint", countType, {intType});
+    createRuntimeFunction(context, "bee_print_char", countType, {intType});
+    createRuntimeFunction(context, "bee_print_double", countType, {doubleType});
+    createRuntimeFunction(context, "bee_print_fixed", countType, {doubleType, intType});
+    createRuntimeFunction(context, "bee_print_bool", voidType, {boolType})
+        ->addParamAttr(0, llvm::Attribute::ZExt);
+    createRuntimeFunction(context, "bee_print_string", countType, {stringType});
+    createRuntimeFunction(context, "bee_print_ints", voidType, {llvm::PointerType::get(intType, 0), intType});
+    createRuntimeFunction(context, "bee_print_intv", voidType, {stringType, intType, intType, boolType})
+        ->addParamAttr(3, llvm::Attribute::ZExt);
+    createRuntimeFunction(context, "bee_print_doubles", voidType, {llvm::PointerType::get(doubleType, 0), intType});
+    createRuntimeFunction(context, "bee_print_floats", voidType, {llvm::PointerType::get(llvm::Type::getFloatTy(context.llvmContext), 0), intType});
+    createRuntimeFunction(context, "bee_print_bools", voidType, {llvm::PointerType::get(boolType, 0), intType});
+    createRuntimeFunction(context, "bee_print_strings", voidType, {llvm::PointerType::get(stringType, 0), intType});
+}
 
-    llvm::Function *func = llvm::Function::Create(
-                echo_type, llvm::Function::InternalLinkage,
-                llvm::Twine("print"),
-                context.module
-           );
-    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(MyContext, "entry", func, 0);
-	context.pushBlock(bblock);
-    
-    const char *constValue = "%d\n";
-    llvm::Constant *format_const = llvm::ConstantDataArray::getString(MyContext, constValue);
+static llvm::CallInst* createRuntimeCall(CodeGenContext& context, const char* name, std::vector<Value*> args)
+{
+    llvm::Function *func = context.module->getFunction(name);
+    return CallInst::Create(func, makeArrayRef(args), "", context.currentBlock());
+}
+
+static llvm::Constant* createStringConstant(CodeGenContext& context, const std::string& str)
+{
+    llvm::Constant *format_const = llvm::ConstantDataArray::getString(context.llvmContext, str);
     llvm::GlobalVariable *var =
         new llvm::GlobalVariable(
-            *context.module, llvm::ArrayType::get(llvm::IntegerType::get(MyContext, 8), strlen(constValue)+1),
+            *context.module, format_const->getType(),
             true, llvm::GlobalValue::PrivateLinkage, format_const, ".str");
     llvm::Constant *zero =
-        llvm::Constant::getNullValue(llvm::IntegerType::getInt32Ty(MyContext));
+        llvm::Constant::getNullValue(llvm::IntegerType::getInt32Ty(context.llvmContext));
 
     std::vector<llvm::Constant*> indices;
     indices.push_back(zero);
     indices.push_back(zero);
-    llvm::Constant *var_ref = llvm::ConstantExpr::getGetElementPtr(
-	llvm::ArrayType::get(llvm::IntegerType::get(MyContext, 8), strlen(constValue)+1), var, indices);
+    return llvm::ConstantExpr::getGetElementPtr(format_const->getType(), var, indices);
+}
+
+/* print(x) / println(x) pick a typed writer from the static type of x.
+   Arrays print as [a, b, c]; literals know their length, variables need print(arr, count) */
+Value* createPrintCall(CodeGenContext& context, ExpressionList& arguments, bool newline)
+{
+    if (arguments.empty()) {
+        if (newline)
+            return createRuntimeCall(context, "bee_newline", {});
+        context.error("print expects a value");
+        return NULL;
+    }
+
+    std::string type = context.typeNameOf(*arguments[0]);
+    Value* value = arguments[0]->codeGen(context);
+    if (value == NULL)
+        return NULL;
+    CallInst* call = NULL;
+
+    if (!type.empty() && type.back() == '~') {
+        Value* count = NULL;
+        if (arguments.size() > 2) {
+            context.error("print takes an array and its count");
+            return NULL;
+        }
+        if (arguments.size() > 1) {
+            count = context.convert(arguments[1]->codeGen(context), context.typeNameOf(*arguments[1]), "int");
+            if (count != NULL && !count->getType()->isIntegerTy()) {
+                context.error("the count printed must be a number, not " + context.typeNameOf(*arguments[1]));
+                return NULL;
+            }
+        } else if (AllocaInst* alloc = dyn_cast<AllocaInst>(value)) {
+            if (alloc->getAllocatedType()->isArrayTy())
+                count = ConstantInt::get(Type::getInt64Ty(context.llvmContext), alloc->getAllocatedType()->getArrayNumElements());
+        }
+        if (count == NULL) {
+            context.error("print of array variable needs a length, use print(arr, count)");
+            return NULL;
+        }
+        type.pop_back();
+        if (type == "int" || type == "i64") {
+            call = createRuntimeCall(context, "bee_print_ints", {value, count});
+        } else if (isIntegerType(type)) {
+            Value* size = ConstantInt::get(Type::getInt64Ty(context.llvmContext), atoi(type.c_str() + 1) / 8);
+            Value* sign = ConstantInt::get(Type::getInt1Ty(context.llvmContext), !isUnsignedType(type));
+            call = createRuntimeCall(context, "bee_print_intv", {value, count, size, sign});
+        }
+        else if (type == "double")  call = createRuntimeCall(context, "bee_print_doubles", {value, count});
+        else if (type == "float")   call = createRuntimeCall(context, "bee_print_floats", {value, count});
+        else if (type == "bool")    call = createRuntimeCall(context, "bee_print_bools", {value, count});
+        else if (type == "string")  call = createRuntimeCall(context, "bee_print_strings", {value, count});
+    } else if (arguments.size() > 1) {
+        context.error("print takes one value, use printf for more");
+        return NULL;
+    } else {
+        if (isUnsignedType(type))       call = createRuntimeCall(context, "bee_print_uint", {context.convert(value, type, "u64")});
+        else if (isIntegerType(type))   call = createRuntimeCall(context, "bee_print_int", {context.convert(value, type, "int")});
+        else if (isFloatType(type))     call = createRuntimeCall(context, "bee_print_double", {context.convert(value, type, "double")});
+        else if (type == "bool")    call = createRuntimeCall(context, "bee_print_bool", {value});
+        else if (type == "string")  call = createRuntimeCall(context, "bee_print_string", {value});
+        else if (type == "view") {
+            Value* data = ExtractValueInst::Create(value, 0, "", context.currentBlock());
+            Value* length = ExtractValueInst::Create(value, 1, "", context.currentBlock());
+            call = createRuntimeCall(context, "bee_write", {data, length});
+        }
+    }
+
+    if (call == NULL) {
+        context.error("cannot print value of type " + type);
+        return NULL;
+    }
+    if (newline)
+        call = createRuntimeCall(context, "bee_newline", {});
+    return call;
+}
+
+class FormatPiece {
+public:
+    std::string literal;
+    int arg;
+    char conversion;
+    long long precision;
+};
+
+/* Splits a constant printf format into literal runs and typed conversions.
+   Returns false for anything the typed writers cannot reproduce exactly */
+static bool splitFormat(CodeGenContext& context, const std::string& format,
+        ExpressionList& arguments, std::vector<FormatPiece>& pieces)
+{
+    std::string literal;
+    unsigned int next = 1;
+
+    for (unsigned int i = 0; i < format.size(); i++) {
+        if (format[i] != '%') {
+            literal += format[i];
+            continue;
+        }
+        unsigned int j = i + 1;
+        if (j < format.size() && format[j] == '%') {
+            literal += '%';
+            i = j;
+            continue;
+        }
+
+        long long precision = -1;
+        if (j < format.size() && format[j] == '.') {
+            precision = 0;
+            for (j++; j < format.size() && isdigit(format[j]); j++)
+                precision = precision * 10 + (format[j] - '0');
+        }
+        while (j < format.size() && format[j] == 'l')
+            j++;
+        if (j >= format.size() || next >= arguments.size())
+            return false;
+
+        char conversion = format[j];
+        std::string type = context.typeNameOf(*arguments[next]);
+        switch (conversion) {
+            case 'd': case 'i': case 'c':
+                if ((!isIntegerType(type) && type != "bool") || precision >= 0)
+                    return false;
+                break;
+            case 'f':
+                if (!isFloatType(type))
+                    return false;
+                if (precision < 0)
+                    precision = 6;
+                break;
+            case 'g':
+                if (!isFloatType(type) || precision >= 0)
+                    return false;
+                break;
+            case 's':
+                if (type != "string" || precision >= 0)
+                    return false;
+                break;
+            default:
+                return false;
+        }
+
+        if (!literal.empty())
+            pieces.push_back({literal, -1, 0, 0});
+        literal.clear();
+        pieces.push_back({"", (int)next++, conversion, precision});
+        i = j;
+    }
+
+    if (!literal.empty())
+        pieces.push_back({literal, -1, 0, 0});
+    return next == arguments.size();
+}
+
+/* printf with a constant format becomes a run of direct typed writes,
+   anything else goes through the buffered bee_printf. Either way it
+   returns the number of bytes written */
+Value* createFormatCall(CodeGenContext& context, ExpressionList& arguments)
+{
+    std::vector<FormatPiece> pieces;
+    NString* format = arguments.empty() ? NULL : dynamic_cast<NString*>(arguments[0]);
 
     std::vector<Value*> args;
-    args.push_back(var_ref);
+    ExpressionList::const_iterator it;
+
+    if (format == NULL || !splitFormat(context, unescapeString(format->value), arguments, pieces)) {
+        /* C variadic promotion: float to double, anything narrower than int to int */
+        for (it = arguments.begin(); it != arguments.end(); it++) {
+            std::string type = context.typeNameOf(**it);
+            if (type == "view") {
+                context.error("printf cannot format a view, write it with print");
+                return NULL;
+            }
+            Value* value = (**it).codeGen(context);
+            if (value == NULL)
+                return NULL;
+            if (type == "float")
+                value = context.convert(value, type, "double");
+            else if (value->getType()->isIntegerTy() && value->getType()->getIntegerBitWidth() < 32)
+                value = context.convert(value, type, isUnsignedType(type) ? "u32" : "i32");
+            args.push_back(value);
+        }
+        return createRuntimeCall(context, "bee_printf", args);
+    }
+
+    /* Evaluate every argument before writing anything, as printf would */
+    args.push_back(NULL);
+    for (it = arguments.begin() + 1; it != arguments.end(); it++) {
+        args.push_back((**it).codeGen(context));
+    }
+
+    Type* countType = Type::getInt32Ty(context.llvmContext);
+    long long literals = 0;
+    Value* written = NULL;
+    for (FormatPiece& piece : pieces) {
+        if (piece.arg < 0) {
+            Value* size = ConstantInt::get(Type::getInt64Ty(context.llvmContext), piece.literal.size());
+            createRuntimeCall(context, "bee_write", {createStringConstant(context, piece.literal), size});
+            literals += piece.literal.size();
+            continue;
+        }
+        Value* value = args[piece.arg];
+        if (value == NULL)
+            return NULL;
+        std::string type = context.typeNameOf(*arguments[piece.arg]);
+        if (type == "bool" || isIntegerType(type))
+            value = context.convert(value, type, "int");
+        else if (type == "float")
+            value = context.convert(value, type, "double");
+        CallInst* call = NULL;
+        switch (piece.conversion) {
+            case 'd': case 'i':
+                call = createRuntimeCall(context, "bee_print_int", {value});
+                break;
+            case 'c':
+                call = createRuntimeCall(context, "bee_print_char", {value});
+                break;
+            case 'f':
+                call = createRuntimeCall(context, "bee_print_fixed",
+                    {value, ConstantInt::get(Type::getInt64Ty(context.llvmContext), piece.precision)});
+                break;
+            case 'g':
+                call = createRuntimeCall(context, "bee_print_double", {value});
+                break;
+            case 's':
+                call = createRuntimeCall(context, "bee_print_string", {value});
+                break;
+        }
+        if (written == NULL)
+            written = call;
+        else
+            written = BinaryOperator::Create(Instruction::Add, written, call, "", context.currentBlock());
+    }
+    Value* total = ConstantInt::get(countType, literals);
+    if (written == NULL)
+        return total;
+    return BinaryOperator::Create(Instruction::Add, written, total, "", context.currentBlock());
+}
+
+/* Declares the memory-mapped file builtins implemented in fileio.cpp.
+   Their BEE signatures are recorded so typeNameOf knows what they return */
+void createFileFunctions(CodeGenContext& context)
+{
+    llvm::Type* voidType = llvm::Type::getVoidTy(context.llvmContext);
+    llvm::Type* intType = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type* doubleType = llvm::Type::getDoubleTy(context.llvmContext);
+    llvm::Type* boolType = llvm::Type::getInt1Ty(context.llvmContext);
+    llvm::Type* stringType = llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0); //char*
+    llvm::Type* viewPointer = llvm::PointerType::get(context.viewType(), 0);
+
+    createRuntimeFunction(context, "bee_mmap_file", voidType, {stringType, viewPointer});
+    createRuntimeFunction(context, "bee_unmap", voidType, {viewPointer});
+    createRuntimeFunction(context, "bee_next_line", boolType, {viewPointer, viewPointer})
+        ->addRetAttr(llvm::Attribute::ZExt);
+    createRuntimeFunction(context, "bee_next_field", boolType, {viewPointer, viewPointer, stringType})
+        ->addRetAttr(llvm::Attribute::ZExt);
+    createRuntimeFunction(context, "bee_parse_int", intType, {stringType, intType});
+    createRuntimeFunction(context, "bee_parse_double", doubleType, {stringType, intType});
+
+    context.signatures["mmap_file"] = {"view", "string"};
+    context.signatures["unmap"] = {"void", "view"};
+    context.signatures["next_line"] = {"bool", "view", "view"};
+    context.signatures["next_field"] = {"bool", "view", "view", "string"};
+    context.signatures["parse_int"] = {"int", "view"};
+    context.signatures["parse_double"] = {"double", "view"};
+    context.signatures["len"] = {"int", "view"};
+}
+
+CodeGenBlock* findLocals(std::stack<CodeGenBlock*> &blocks, std::string& name);
+
+/* next_line and next_field advance their first argument and fill in their
+   second, and unmap empties its argument, so all of them take view variables */
+static Value* viewAddress(CodeGenContext& context, const std::string& function, NExpression& expr)
+{
+    NIdentifier* ident = dynamic_cast<NIdentifier*>(&expr);
+    CodeGenBlock* b = ident == NULL ? NULL : findLocals(context.blocks, ident->name);
+    if (b == NULL) {
+        context.error(function + " needs view variables, not expressions");
+        return NULL;
+    }
+    return b->locals[ident->name];
+}
+
+/* mmap_file(path) gives a view of a whole file, next_line(rest, line) and
+   next_field(rest, field, ",") split views without copying them */
+Value* createViewCall(CodeGenContext& context, const std::string& name, ExpressionList& arguments)
+{
+    const std::vector<std::string>& signature = context.signatures[name];
+    if (arguments.size() != signature.size() - 1) {
+        context.error(name + " expects " + std::to_string(signature.size() - 1) + " arguments");
+        return NULL;
+    }
+    for (unsigned int i = 0; i < arguments.size(); i++) {
+        if (context.typeNameOf(*arguments[i]) != signature[i + 1]) {
+            context.error(name + " expects a " + signature[i + 1] + " as argument " + std::to_string(i + 1));
+            return NULL;
+        }
+    }
+
+    if (name == "mmap_file") {
+        Value* path = arguments[0]->codeGen(context);
+        if (path == NULL)
+            return NULL;
+        AllocaInst* view = new AllocaInst(context.viewType(), 0, "", context.currentBlock());
+        createRuntimeCall(context, "bee_mmap_file", {path, view});
+        return new LoadInst(context.viewType(), view, "", false, context.currentBlock());
+    }
+
+    if (name == "next_line" || name == "next_field") {
+        Value* rest = viewAddress(context, name, *arguments[0]);
+        Value* part = viewAddress(context, name, *arguments[1]);
+        if (rest == NULL || part == NULL)
+            return NULL;
+        if (name == "next_line")
+            return createRuntimeCall(context, "bee_next_line", {rest, part});
+        Value* delimiter = arguments[2]->codeGen(context);
+        if (delimiter == NULL)
+            return NULL;
+        return createRuntimeCall(context, "bee_next_field", {rest, part, delimiter});
+    }
+
+    if (name == "unmap") {
+        Value* view = viewAddress(context, name, *arguments[0]);
+        if (view == NULL)
+            return NULL;
+        return createRuntimeCall(context, "bee_unmap", {view});
+    }
+
+    Value* view = arguments[0]->codeGen(context);
+    if (view == NULL)
+        return NULL;
+    Value* data = ExtractValueInst::Create(view, 0, "", context.currentBlock());
+    Value* length = ExtractValueInst::Create(view, 1, "", context.currentBlock());
+
+    if (name == "len")
+        return length;
+    if (name == "parse_int")
+        return createRuntimeCall(context, "bee_parse_int", {data, length});
+    return createRuntimeCall(context, "bee_parse_double", {data, length});
+}
+
+/* Sized arrays are zeroed heap blocks, generator frames plain ones */
+void createMemoryFunctions(CodeGenContext& context)
+{
+    llvm::Type* intType = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type* pointerType = llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0);
+
+    createRuntimeFunction(context, "calloc", pointerType, {intType, intType});
+    createRuntimeFunction(context, "malloc", pointerType, {intType});
+    createRuntimeFunction(context, "free", llvm::Type::getVoidTy(context.llvmContext), {pointerType});
+    llvm::Function* outOfMemory = createRuntimeFunction(context, "bee_out_of_memory", llvm::Type::getVoidTy(context.llvmContext), {});
+    outOfMemory->addFnAttr(llvm::Attribute::NoReturn);
+    outOfMemory->addFnAttr(llvm::Attribute::Cold);
+}
+
+/* Declares the map runtime implemented in hashmap.cpp. Only the result of
+   contains is fixed, its arguments depend on the map */
+void createMapFunctions(CodeGenContext& context)
+{
+    llvm::Type* intType = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type* boolType = llvm::Type::getInt1Ty(context.llvmContext);
+    llvm::Type* pointerType = llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0);
+
+    createRuntimeFunction(context, "bee_map_new", pointerType, {});
+    createRuntimeFunction(context, "bee_map_free_int", llvm::Type::getVoidTy(context.llvmContext), {pointerType});
+    createRuntimeFunction(context, "bee_map_free_string", llvm::Type::getVoidTy(context.llvmContext), {pointerType});
+    createRuntimeFunction(context, "bee_map_get_int", pointerType, {pointerType, intType});
+    createRuntimeFunction(context, "bee_map_get_string", pointerType, {pointerType, pointerType});
+    createRuntimeFunction(context, "bee_map_put_int", pointerType, {pointerType, intType});
+    createRuntimeFunction(context, "bee_map_put_string", pointerType, {pointerType, pointerType});
+    createRuntimeFunction(context, "bee_map_contains_int", boolType, {pointerType, intType})
+        ->addRetAttr(llvm::Attribute::ZExt);
+    createRuntimeFunction(context, "bee_map_contains_string", boolType, {pointerType, pointerType})
+        ->addRetAttr(llvm::Attribute::ZExt);
+    createRuntimeFunction(context, "bee_map_len", intType, {pointerType});
+    createRuntimeFunction(context, "bee_map_next", boolType, {pointerType, pointerType, pointerType})
+        ->addRetAttr(llvm::Attribute::ZExt);
+
+    context.signatures["contains"] = {"bool"};
+}
+
+/* contains(m, key) and len(m) on maps */
+Value* createMapCall(CodeGenContext& context, const std::string& name, ExpressionList& arguments)
+{
+    unsigned int count = name == "len" ? 1 : 2;
+    if (arguments.size() != count) {
+        context.error(name + " expects " + std::to_string(count) + " arguments");
+        return NULL;
+    }
+    std::string type = context.typeNameOf(*arguments[0]);
+    if (!isMapType(type)) {
+        context.error(name + " expects a map as argument 1");
+        return NULL;
+    }
+
+    Value* map = arguments[0]->codeGen(context);
+    if (map == NULL)
+        return NULL;
+    if (name == "len")
+        return createRuntimeCall(context, "bee_map_len", {map});
+
+    Value* key = createMapKey(context, type, *arguments[1]);
+    if (key == NULL)
+        return NULL;
+    return createRuntimeCall(context, mapKeyType(type) == "string" ? "bee_map_contains_string" : "bee_map_contains_int", {map, key});
+}
+
+/* Suffix of the sort.cpp functions for an element type, empty if it has none */
+static std::string sortSuffix(const std::string& type)
+{
+    if (type == "int")
+        return "i64";
+    if (type == "float")
+        return "f32";
+    if (type == "double")
+        return "f64";
+    if (type == "string" || isIntegerType(type))
+        return type;
+    return "";
+}
+
+/* Values cross into sort.cpp as 64 bits of their kind */
+static std::string sortValueType(const std::string& type)
+{
+    if (isUnsignedType(type))
+        return "u64";
+    if (isIntegerType(type))
+        return "int";
+    if (isFloatType(type))
+        return "double";
+    return "string";
+}
+
+/* Declares the sorting and searching runtime in sort.cpp, one set of functions per element type */
+void createSortFunctions(CodeGenContext& context)
+{
+    llvm::Type* voidType = llvm::Type::getVoidTy(context.llvmContext);
+    llvm::Type* intType = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type* doubleType = llvm::Type::getDoubleTy(context.llvmContext);
+    llvm::Type* pointerType = llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0);
+
+    const char* types[] = { "i8", "i16", "i32", "int", "u8", "u16", "u32", "u64", "float", "double", "string" };
+    for (const char* type : types) {
+        std::string suffix = sortSuffix(type);
+        std::string valueType = sortValueType(type);
+        llvm::Type* value = valueType == "double" ? doubleType : valueType == "string" ? pointerType : intType;
+        createRuntimeFunction(context, ("bee_sort_" + suffix).c_str(), voidType, {pointerType, intType});
+        createRuntimeFunction(context, ("bee_binary_search_" + suffix).c_str(), intType, {pointerType, intType, value});
+        createRuntimeFunction(context, ("bee_partition_" + suffix).c_str(), intType, {pointerType, intType, value});
+        createRuntimeFunction(context, ("bee_nth_element_" + suffix).c_str(), value, {pointerType, intType, intType});
+    }
+
+    context.signatures["sort"] = {"void"};
+    context.signatures["sort_by"] = {"void"};
+    context.signatures["binary_search"] = {"int"};
+    context.signatures["partition"] = {"int"};
+}
+
+static Value* loadElement(Type* type, Value* array, Value* index, BasicBlock* block)
+{
+    Value* address = GetElementPtrInst::Create(type, array, {index}, "", block);
+    return new LoadInst(type, address, "", false, block);
+}
+
+static void storeElement(Value* value, Type* type, Value* array, Value* index, BasicBlock* block)
+{
+    Value* address = GetElementPtrInst::Create(type, array, {index}, "", block);
+    new StoreInst(value, address, false, block);
+}
+
+static Value* minimum(Value* a, Value* b, BasicBlock* block)
+{
+    Value* less = new ICmpInst(*block, ICmpInst::ICMP_SLT, a, b, "");
+    return SelectInst::Create(less, a, b, "", block);
+}
+
+/* sort_by(arr, n, less) gets its own sort with less called directly, so the
+   optimizer inlines the comparison. It is a stable merge sort: runs of 16
+   are insertion sorted in place, then merged bottom up through a buffer */
+static Function* createSortByFunction(CodeGenContext& context, Function* less, Type* type)
+{
+    std::string name = "bee.sort_by." + less->getName().str();
+    if (Function* function = context.module->getFunction(name))
+        return function;
+
+    llvm::Type* intType = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type* pointerType = llvm::PointerType::get(type, 0);
+    FunctionType* functionType = FunctionType::get(llvm::Type::getVoidTy(context.llvmContext), {pointerType, intType}, false);
+    Function* function = Function::Create(functionType, GlobalValue::InternalLinkage, name, context.module);
+    context.createSubprogram(function, context.line);
+    Value* data = function->getArg(0);
+    Value* n = function->getArg(1);
+    Value* run = ConstantInt::get(intType, 16);
+    Value* one = ConstantInt::get(intType, 1);
+    Value* zero = ConstantInt::get(intType, 0);
+
+    BasicBlock* entry = BasicBlock::Create(context.llvmContext, "entry", function);
+    AllocaInst* start = new AllocaInst(intType, 0, "start", entry);
+    AllocaInst* i = new AllocaInst(intType, 0, "i", entry);
+    AllocaInst* j = new AllocaInst(intType, 0, "j", entry);
+    AllocaInst* k = new AllocaInst(intType, 0, "k", entry);
+    AllocaInst* width = new AllocaInst(intType, 0, "width", entry);
+    AllocaInst* low = new AllocaInst(intType, 0, "low", entry);
+    AllocaInst* source = new AllocaInst(pointerType, 0, "source", entry);
+    AllocaInst* target = new AllocaInst(pointerType, 0, "target", entry);
+    new StoreInst(zero, start, false, entry);
+
+    /* Insertion sort of each run */
+    BasicBlock* runs = BasicBlock::Create(context.llvmContext, "runs", function);
+    BasicBlock* runBody = BasicBlock::Create(context.llvmContext, "run", function);
+    BasicBlock* outer = BasicBlock::Create(context.llvmContext, "outer", function);
+    BasicBlock* outerBody = BasicBlock::Create(context.llvmContext, "insert", function);
+    BasicBlock* inner = BasicBlock::Create(context.llvmContext, "inner", function);
+    BasicBlock* innerCompare = BasicBlock::Create(context.llvmContext, "compare", function);
+    BasicBlock* innerMove = BasicBlock::Create(context.llvmContext, "move", function);
+    BasicBlock* innerDone = BasicBlock::Create(context.llvmContext, "place", function);
+    BasicBlock* runNext = BasicBlock::Create(context.llvmContext, "next", function);
+    BasicBlock* runsDone = BasicBlock::Create(context.llvmContext, "sorted", function);
+    BranchInst::Create(runs, entry);
+
+    Value* s = new LoadInst(intType, start, "", false, runs);
+    BranchInst::Create(runBody, runsDone, new ICmpInst(*runs, ICmpInst::ICMP_SLT, s, n, ""), runs);
+
+    Value* end = minimum(BinaryOperator::Create(Instruction::Add, s, run, "", runBody), n, runBody);
+    new StoreInst(BinaryOperator::Create(Instruction::Add, s, one, "", runBody), i, false, runBody);
+    BranchInst::Create(outer, runBody);
+
+    Value* iv = new LoadInst(intType, i, "", false, outer);
+    BranchInst::Create(outerBody, runNext, new ICmpInst(*outer, ICmpInst::ICMP_SLT, iv, end, ""), outer);
+
+    Value* value = loadElement(type, data, iv, outerBody);
+    new StoreInst(iv, j, false, outerBody);
+    BranchInst::Create(inner, outerBody);
+
+    Value* jv = new LoadInst(intType, j, "", false, inner);
+    BranchInst::Create(innerCompare, innerDone, new ICmpInst(*inner, ICmpInst::ICMP_SGT, jv, s, ""), inner);
+
+    Value* previousIndex = BinaryOperator::Create(Instruction::Sub, jv, one, "", innerCompare);
+    Value* previous = loadElement(type, data, previousIndex, innerCompare);
+    Value* before = CallInst::Create(less, {value, previous}, "", innerCompare);
+    BranchInst::Create(innerMove, innerDone, before, innerCompare);
+
+    storeElement(previous, type, data, jv, innerMove);
+    new StoreInst(previousIndex, j, false, innerMove);
+    BranchInst::Create(inner, innerMove);
+
+    storeElement(value, type, data, new LoadInst(intType, j, "", false, innerDone), innerDone);
+    new StoreInst(BinaryOperator::Create(Instruction::Add, iv, one, "", innerDone), i, false, innerDone);
+    BranchInst::Create(outer, innerDone);
+
+    new StoreInst(BinaryOperator::Create(Instruction::Add, s, run, "", runNext), start, false, runNext);
+    BranchInst::Create(runs, runNext);
+
+    /* Merge neighbouring runs of width into runs of twice that, back and forth between data and the buffer */
+    BasicBlock* setup = BasicBlock::Create(context.llvmContext, "setup", function);
+    BasicBlock* widths = BasicBlock::Create(context.llvmContext, "widths", function);
+    BasicBlock* widthBody = BasicBlock::Create(context.llvmContext, "width", function);
+    BasicBlock* pairs = BasicBlock::Create(context.llvmContext, "pairs", function);
+    BasicBlock* pairBody = BasicBlock::Create(context.llvmContext, "pair", function);
+    BasicBlock* merge = BasicBlock::Create(context.llvmContext, "merge", function);
+    BasicBlock* mergeBody = BasicBlock::Create(context.llvmContext, "step", function);
+    BasicBlock* checkLeft = BasicBlock::Create(context.llvmContext, "left", function);
+    BasicBlock* compare = BasicBlock::Create(context.llvmContext, "order", function);
+    BasicBlock* takeRight = BasicBlock::Create(context.llvmContext, "right", function);
+    BasicBlock* takeLeft = BasicBlock::Create(context.llvmContext, "take", function);
+    BasicBlock* mergeNext = BasicBlock::Create(context.llvmContext, "advance", function);
+    BasicBlock* pairNext = BasicBlock::Create(context.llvmContext, "following", function);
+    BasicBlock* pairsDone = BasicBlock::Create(context.llvmContext, "merged", function);
+    BasicBlock* widthsDone = BasicBlock::Create(context.llvmContext, "done", function);
+    BasicBlock* copy = BasicBlock::Create(context.llvmContext, "copy", function);
+    BasicBlock* copyBody = BasicBlock::Create(context.llvmContext, "back", function);
+    BasicBlock* release = BasicBlock::Create(context.llvmContext, "release", function);
+    BasicBlock* exit = BasicBlock::Create(context.llvmContext, "exit", function);
+    BranchInst::Create(setup, exit, new ICmpInst(*runsDone, ICmpInst::ICMP_SGT, n, run, ""), runsDone);
+
+    Value* size = ConstantExpr::getSizeOf(type);
+    Value* buffer = CallInst::Create(context.module->getFunction("calloc"), {n, size}, "", setup);
+    BasicBlock* failed = BasicBlock::Create(context.llvmContext, "oom", function);
+    BasicBlock* ready = BasicBlock::Create(context.llvmContext, "ready", function);
+    Value* none = ConstantPointerNull::get(cast<PointerType>(buffer->getType()));
+    BranchInst::Create(failed, ready, new ICmpInst(*setup, ICmpInst::ICMP_EQ, buffer, none, ""), setup);
+    CallInst::Create(context.module->getFunction("bee_out_of_memory"), "", failed);
+    new UnreachableInst(context.llvmContext, failed);
+
+    new StoreInst(data, source, false, ready);
+    new StoreInst(buffer, target, false, ready);
+    new StoreInst(run, width, false, ready);
+    BranchInst::Create(widths, ready);
+
+    Value* w = new LoadInst(intType, width, "", false, widths);
+    BranchInst::Create(widthBody, widthsDone, new ICmpInst(*widths, ICmpInst::ICMP_SLT, w, n, ""), widths);
+
+    Value* from = new LoadInst(pointerType, source, "", false, widthBody);
+    Value* to = new LoadInst(pointerType, target, "", false, widthBody);
+    Value* twice = BinaryOperator::Create(Instruction::Add, w, w, "", widthBody);
+    new StoreInst(zero, low, false, widthBody);
+    BranchInst::Create(pairs, widthBody);
+
+    Value* l = new LoadInst(intType, low, "", false, pairs);
+    BranchInst::Create(pairBody, pairsDone, new ICmpInst(*pairs, ICmpInst::ICMP_SLT, l, n, ""), pairs);
+
+    Value* middle = minimum(BinaryOperator::Create(Instruction::Add, l, w, "", pairBody), n, pairBody);
+    Value* high = minimum(BinaryOperator::Create(Instruction::Add, l, twice, "", pairBody), n, pairBody);
+    new StoreInst(l, i, false, pairBody);
+    new StoreInst(middle, j, false, pairBody);
+    new StoreInst(l, k, false, pairBody);
+    BranchInst::Create(merge, pairBody);
+
+    Value* kv = new LoadInst(intType, k, "", false, merge);
+    BranchInst::Create(mergeBody, pairNext, new ICmpInst(*merge, ICmpInst::ICMP_SLT, kv, high, ""), merge);
+
+    Value* right = new LoadInst(intType, j, "", false, mergeBody);
+    BranchInst::Create(checkLeft, takeLeft, new ICmpInst(*mergeBody, ICmpInst::ICMP_SLT, right, high, ""), mergeBody);
+
+    Value* left = new LoadInst(intType, i, "", false, checkLeft);
+    BranchInst::Create(compare, takeRight, new ICmpInst(*checkLeft, ICmpInst::ICMP_SLT, left, middle, ""), checkLeft);
+
+    /* Taking the left element on ties keeps equal elements in order */
+    Value* rightValue = loadElement(type, from, right, compare);
+    Value* leftValue = loadElement(type, from, left, compare);
+    BranchInst::Create(takeRight, takeLeft, CallInst::Create(less, {rightValue, leftValue}, "", compare), compare);
+
+    Value* r = new LoadInst(intType, j, "", false, takeRight);
+    storeElement(loadElement(type, from, r, takeRight), type, to, kv, takeRight);
+    new StoreInst(BinaryOperator::Create(Instruction::Add, r, one, "", takeRight), j, false, takeRight);
+    BranchInst::Create(mergeNext, takeRight);
+
+    Value* t = new LoadInst(intType, i, "", false, takeLeft);
+    storeElement(loadElement(type, from, t, takeLeft), type, to, kv, takeLeft);
+    new StoreInst(BinaryOperator::Create(Instruction::Add, t, one, "", takeLeft), i, false, takeLeft);
+    BranchInst::Create(mergeNext, takeLeft);
+
+    new StoreInst(BinaryOperator::Create(Instruction::Add, kv, one, "", mergeNext), k, false, mergeNext);
+    BranchInst::Create(merge, mergeNext);
+
+    new StoreInst(BinaryOperator::Create(Instruction::Add, l, twice, "", pairNext), low, false, pairNext);
+    BranchInst::Create(pairs, pairNext);
+
+    new StoreInst(to, source, false, pairsDone);
+    new StoreInst(from, target, false, pairsDone);
+    new StoreInst(twice, width, false, pairsDone);
+    BranchInst::Create(widths, pairsDone);
+
+    /* An odd number of rounds leaves the result in the buffer */
+    Value* result = new LoadInst(pointerType, source, "", false, widthsDone);
+    new StoreInst(zero, i, false, widthsDone);
+    BranchInst::Create(release, copy, new ICmpInst(*widthsDone, ICmpInst::ICMP_EQ, result, data, ""), widthsDone);
+
+    Value* c = new LoadInst(intType, i, "", false, copy);
+    BranchInst::Create(copyBody, release, new ICmpInst(*copy, ICmpInst::ICMP_SLT, c, n, ""), copy);
+
+    storeElement(loadElement(type, result, c, copyBody), type, data, c, copyBody);
+    new StoreInst(BinaryOperator::Create(Instruction::Add, c, one, "", copyBody), i, false, copyBody);
+    BranchInst::Create(copy, copyBody);
+
+    CallInst::Create(context.module->getFunction("free"), {buffer}, "", release);
+    BranchInst::Create(exit, release);
+    ReturnInst::Create(context.llvmContext, exit);
+
+    context.setLocations(function, NULL, NULL, NULL, context.line, 0);
+    return function;
+}
+
+/* sort(arr, n), sort_by(arr, n, less), binary_search(arr, n, x),
+   partition(arr, n, pivot) and nth_element(arr, n, k) on the first n
+   elements of an array. Comparison functions for sort_by are BEE
+   functions taking two elements and returning true if the first goes first */
+Value* createSortCall(CodeGenContext& context, const std::string& name, ExpressionList& arguments)
+{
+    unsigned int count = name == "sort" ? 2 : 3;
+    if (arguments.size() != count) {
+        context.error(name + " expects " + std::to_string(count) + " arguments");
+        return NULL;
+    }
+    std::string type = context.typeNameOf(*arguments[0]);
+    if (type.empty() || type.back() != '~') {
+        context.error(name + " expects an array as argument 1");
+        return NULL;
+    }
+    type.pop_back();
+
+    Function* less = NULL;
+    if (name == "sort_by") {
+        NIdentifier* ident = dynamic_cast<NIdentifier*>(arguments[2]);
+        less = ident == NULL ? NULL : context.module->getFunction(ident->name);
+        std::vector<std::string> expected = {"bool", type, type};
+        if (context.structs.find(type) != context.structs.end()) {
+            context.error("sort_by cannot be used on arrays of structs");
+            return NULL;
+        }
+        if (less == NULL || context.signatures[ident->name] != expected) {
+            context.error("sort_by expects a function bool(" + type + ", " + type + ") as argument 3");
+            return NULL;
+        }
+    } else if (sortSuffix(type).empty()) {
+        context.error(name + " cannot be used on arrays of " + type);
+        return NULL;
+    }
+
+    Value* data = arguments[0]->codeGen(context);
+    Value* n = context.convert(arguments[1]->codeGen(context), context.typeNameOf(*arguments[1]), "int");
+    if (data == NULL || n == NULL)
+        return NULL;
+
+    if (name == "sort_by")
+        return CallInst::Create(createSortByFunction(context, less, typeOf(context, type)), {data, n}, "", context.currentBlock());
+    std::string suffix = sortSuffix(type);
+    if (name == "sort")
+        return createRuntimeCall(context, ("bee_sort_" + suffix).c_str(), {data, n});
+
+    std::string from = context.typeNameOf(*arguments[2]);
+    Value* value = arguments[2]->codeGen(context);
+    if (value == NULL)
+        return NULL;
+    if (name == "nth_element") {
+        Value* k = context.convert(value, from, "int");
+        Value* element = createRuntimeCall(context, ("bee_nth_element_" + suffix).c_str(), {data, n, k});
+        return context.convert(element, sortValueType(type), type);
+    }
+    if ((type == "string") != (from == "string")) {
+        context.error(name + " on a " + type + " array needs a " + type + ", not " + from);
+        return NULL;
+    }
+    value = context.convert(context.convert(value, from, type), type, sortValueType(type));
+    return createRuntimeCall(context, ("bee_" + name + "_" + suffix).c_str(), {data, n, value});
+}
+
+/* String hashing and equality for switch dispatch, see hash.cpp */
+void createStringFunctions(CodeGenContext& context)
+{
+    llvm::Type* intType = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type* boolType = llvm::Type::getInt1Ty(context.llvmContext);
+    llvm::Type* stringType = llvm::PointerType::get(Type::getInt8Ty(context.llvmContext), 0);
 
-    Function::arg_iterator argsValues = func->arg_begin();
-    Value* toPrint = &*argsValues++;
-    toPrint->setName("toPrint");
-    args.push_back(toPrint);
-    
-	CallInst *call = CallInst::Create(printfFn, makeArrayRef(args), "", bblock);
-	ReturnInst::Create(MyContext, bblock);
-	context.popBlock();
+    createRuntimeFunction(context, "bee_hash", intType, {stringType, intType});
+    createRuntimeFunction(context, "bee_equal", boolType, {stringType, stringType})
+        ->addRetAttr(llvm::Attribute::ZExt);
 }
 
 void createCoreFunctions(CodeGenContext& context){
-	llvm::Function* printfFn = createPrintfFunction(context);
-    //createPrintFunction(context, printfFn);
+    createOutputFunctions(context);
+    createMemoryFunctions(context);
+    createFileFunctions(context);
+    createStringFunctions(context);
+    createMapFunctions(context);
+    createSortFunctions(context);
 }
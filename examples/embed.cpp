@@ -0,0 +1,34 @@
+// Embeds BEE in a C++ program: compile once, call many times.
+// Build with `make embed`
+
+#include <cstdio>
+#include "../bee.h"
+
+int main()
+{
+	bee::Engine engine;
+	std::string error;
+
+	std::unique_ptr<bee::Program> program = engine.compile(
+		"int score(int hits, int misses) { return hits * 10 - misses; }", error);
+	if (program == NULL) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	auto score = program->function<long long(long long, long long)>("score");
+	long long total = 0;
+	for (long long i = 0; i < 1000000; i++)
+		total += score(i % 7, i % 3);
+	printf("total = %lld\n", total);
+
+	// Scripts can be swapped out while the host keeps running
+	if (!program->reload("int score(int hits, int misses) { return hits - misses; }", error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	score = program->function<long long(long long, long long)>("score");
+	printf("score(5, 2) = %lld\n", score(5, 2));
+
+	return 0;
+}
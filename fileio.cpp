@@ -0,0 +1,162 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Memory-mapped file input. A view is a read-only window onto bytes BEE
+   does not own, laid out as BEE's view type, so nothing here ever copies.
+   base and size are the whole mapping, so a view can still be unmapped
+   after next_line has moved it along; views split off it map nothing */
+struct BeeView {
+    const char* data;
+    long long length;
+    const char* base;
+    long long size;
+};
+
+/* Maps the whole file read-only. A file that cannot be mapped is reported
+   on stderr and gives an empty view */
+extern "C"
+void bee_mmap_file(const char* path, BeeView* view)
+{
+    view->data = "";
+    view->length = 0;
+    view->base = NULL;
+    view->size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "mmap_file: cannot open %s: %s\n", path, strerror(errno));
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        fprintf(stderr, "mmap_file: cannot stat %s: %s\n", path, strerror(errno));
+    } else if (info.st_size > 0) {
+        void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "mmap_file: cannot map %s: %s\n", path, strerror(errno));
+        } else {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            view->data = (const char*)data;
+            view->length = info.st_size;
+            view->base = view->data;
+            view->size = info.st_size;
+        }
+    }
+    close(fd);
+}
+
+/* Releases the mapping behind a view and leaves the view empty */
+extern "C"
+void bee_unmap(BeeView* view)
+{
+    if (view->size > 0 && munmap((void*)view->base, view->size) != 0)
+        fprintf(stderr, "unmap: %s\n", strerror(errno));
+    view->data = "";
+    view->length = 0;
+    view->base = NULL;
+    view->size = 0;
+}
+
+/* Splits the next line off the front of rest, without its \n or \r\n */
+extern "C"
+bool bee_next_line(BeeView* rest, BeeView* line)
+{
+    if (rest->length <= 0)
+        return false;
+
+    const char* end = (const char*)memchr(rest->data, '\n', rest->length);
+    long long size = end != NULL ? end - rest->data : rest->length;
+    line->data = rest->data;
+    line->length = size > 0 && rest->data[size - 1] == '\r' ? size - 1 : size;
+    line->base = NULL;
+    line->size = 0;
+
+    long long used = end != NULL ? size + 1 : size;
+    rest->data += used;
+    rest->length -= used;
+    return true;
+}
+
+/* Splits the next field off the front of rest at the first byte of delimiter */
+extern "C"
+bool bee_next_field(BeeView* rest, BeeView* field, const char* delimiter)
+{
+    if (rest->length <= 0)
+        return false;
+
+    const char* end = (const char*)memchr(rest->data, delimiter[0], rest->length);
+    long long size = end != NULL ? end - rest->data : rest->length;
+    field->data = rest->data;
+    field->length = size;
+    field->base = NULL;
+    field->size = 0;
+
+    long long used = end != NULL ? size + 1 : size;
+    rest->data += used;
+    rest->length -= used;
+    return true;
+}
+
+/* Leading blanks and a sign are allowed, parsing stops at the first non-digit */
+extern "C"
+long long bee_parse_int(const char* data, long long length)
+{
+    const char* p = data;
+    const char* end = data + length;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        p++;
+
+    unsigned long long value = 0;
+    for (; p < end && isdigit((unsigned char)*p); p++)
+        value = value * 10 + (*p - '0');
+    return negative ? 0ULL - value : value;
+}
+
+/* Up to 15 significant digits without an exponent are exact in a double, and so
+   is dividing by a power of ten up to 1e22, which covers most real data.
+   Anything else goes through strtod */
+extern "C"
+double bee_parse_double(const char* data, long long length)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+        1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+    };
+
+    const char* p = data;
+    const char* end = data + length;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        p++;
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    for (; p < end && isdigit((unsigned char)*p); p++, digits++)
+        mantissa = mantissa * 10 + (*p - '0');
+    if (p < end && *p == '.') {
+        for (p++; p < end && isdigit((unsigned char)*p); p++, digits++, scale++)
+            mantissa = mantissa * 10 + (*p - '0');
+    }
+
+    if (digits > 0 && digits <= 15 && (p == end || (*p != 'e' && *p != 'E'))) {
+        double value = (double)mantissa / powers[scale];
+        return negative ? -value : value;
+    }
+
+    std::string copy(data, length);
+    return strtod(copy.c_str(), NULL);
+}
@@ -0,0 +1,27 @@
+#include <cstring>
+
+/* The string hash shared by the compiler and the runtime. Switch statements
+   on strings hash their cases at compile time and the subject at run time,
+   so both sides must agree on every bit */
+
+/* FNV-1a over the bytes up to the NUL, then a final mix so the low bits,
+   which pick table slots, depend on every byte */
+extern "C"
+unsigned long long bee_hash(const char* string, unsigned long long seed)
+{
+    unsigned long long hash = 14695981039346656037ULL ^ seed;
+    for (const unsigned char* p = (const unsigned char*)string; *p != 0; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+extern "C"
+bool bee_equal(const char* a, const char* b)
+{
+    return strcmp(a, b) == 0;
+}
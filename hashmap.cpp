@@ -0,0 +1,254 @@
+#include <cstdlib>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C" unsigned long long bee_hash(const char* string, unsigned long long seed);
+extern "C" void bee_out_of_memory();
+
+static void* checked(void* memory)
+{
+    if (memory == NULL)
+        bee_out_of_memory();
+    return memory;
+}
+
+/* BEE's map type, a Swiss table. Every slot has a control byte, EMPTY or the
+   low 7 bits of its key's hash, and the control bytes of a group of 16 slots
+   are compared against a hash in one SIMD instruction, so a lookup usually
+   touches one group and compares one key. The rest of the hash picks the
+   group to start at. Keys are stored as 8 bytes, an integer or a pointer to
+   a copy of a string, and so are values, which fits every BEE scalar */
+struct BeeMap {
+    unsigned char* control;
+    unsigned long long* keys;
+    unsigned long long* values;
+    long long capacity;
+    long long count;
+};
+
+static const unsigned char EMPTY = 0x80;
+static const long long GROUP = 16;
+
+/* Bit i is set when control byte i of the group equals byte */
+static inline unsigned int matchByte(const unsigned char* control, unsigned char byte)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i*)control);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < GROUP; i++)
+        mask |= (unsigned int)(control[i] == byte) << i;
+    return mask;
+#endif
+}
+
+/* The hash and equality of each key type, integers never call out of line */
+struct IntKeys {
+    typedef long long Key;
+    static unsigned long long hash(Key key)
+    {
+        unsigned long long hash = (unsigned long long)key * 0x9e3779b97f4a7c15ULL;
+        return hash ^ (hash >> 29);
+    }
+    static unsigned long long hashStored(unsigned long long stored) { return hash((Key)stored); }
+    static bool equal(unsigned long long stored, Key key) { return (Key)stored == key; }
+    static unsigned long long store(Key key) { return (unsigned long long)key; }
+    static void release(unsigned long long) {}
+};
+
+struct StringKeys {
+    typedef const char* Key;
+    static unsigned long long hash(Key key) { return bee_hash(key, 0); }
+    static unsigned long long hashStored(unsigned long long stored) { return hash((Key)stored); }
+    static bool equal(unsigned long long stored, Key key) { return strcmp((Key)stored, key) == 0; }
+    static unsigned long long store(Key key) { return (unsigned long long)checked(strdup(key)); }
+    static void release(unsigned long long stored) { free((void*)stored); }
+};
+
+/* Groups are probed triangularly, 1, 2, 3... groups apart, which visits
+   every group of a power of two table. The table is never full */
+template <typename K>
+static long long findSlot(BeeMap* map, typename K::Key key, unsigned long long hash)
+{
+    unsigned long long groups = map->capacity / GROUP;
+    unsigned long long group = (hash >> 7) & (groups - 1);
+    for (unsigned long long step = 1; ; step++) {
+        const unsigned char* control = map->control + group * GROUP;
+        for (unsigned int mask = matchByte(control, hash & 0x7f); mask != 0; mask &= mask - 1) {
+            long long slot = group * GROUP + __builtin_ctz(mask);
+            if (K::equal(map->keys[slot], key))
+                return slot;
+        }
+        if (matchByte(control, EMPTY) != 0)
+            return -1;
+        group = (group + step) & (groups - 1);
+    }
+}
+
+static long long emptySlot(BeeMap* map, unsigned long long hash)
+{
+    unsigned long long groups = map->capacity / GROUP;
+    unsigned long long group = (hash >> 7) & (groups - 1);
+    for (unsigned long long step = 1; ; step++) {
+        unsigned int mask = matchByte(map->control + group * GROUP, EMPTY);
+        if (mask != 0)
+            return group * GROUP + __builtin_ctz(mask);
+        group = (group + step) & (groups - 1);
+    }
+}
+
+static void allocate(BeeMap* map, long long capacity)
+{
+    map->control = (unsigned char*)checked(malloc(capacity));
+    memset(map->control, EMPTY, capacity);
+    map->keys = (unsigned long long*)checked(malloc(capacity * sizeof(unsigned long long)));
+    map->values = (unsigned long long*)checked(calloc(capacity, sizeof(unsigned long long)));
+    map->capacity = capacity;
+}
+
+/* Doubles the table and moves every entry, keys keep their copies */
+template <typename K>
+static void grow(BeeMap* map)
+{
+    BeeMap old = *map;
+    allocate(map, old.capacity * 2);
+    for (long long i = 0; i < old.capacity; i++) {
+        if (old.control[i] == EMPTY)
+            continue;
+        unsigned long long hash = K::hashStored(old.keys[i]);
+        long long slot = emptySlot(map, hash);
+        map->control[slot] = hash & 0x7f;
+        map->keys[slot] = old.keys[i];
+        map->values[slot] = old.values[i];
+    }
+    free(old.control);
+    free(old.keys);
+    free(old.values);
+}
+
+/* Address of the value of key, a new zero value if the key was missing.
+   Adding keys may move every value, so addresses only last until the next put */
+template <typename K>
+static void* put(BeeMap* map, typename K::Key key)
+{
+    unsigned long long hash = K::hash(key);
+    long long slot = findSlot<K>(map, key, hash);
+    if (slot >= 0)
+        return &map->values[slot];
+
+    /* At most 7/8 full keeps probe sequences short */
+    if ((map->count + 1) * 8 > map->capacity * 7)
+        grow<K>(map);
+    slot = emptySlot(map, hash);
+    map->control[slot] = hash & 0x7f;
+    map->keys[slot] = K::store(key);
+    map->values[slot] = 0;
+    map->count++;
+    return &map->values[slot];
+}
+
+/* Reading a missing key gives zero, false, 0.0 or NULL */
+static unsigned long long missing = 0;
+
+template <typename K>
+static void* get(BeeMap* map, typename K::Key key)
+{
+    long long slot = findSlot<K>(map, key, K::hash(key));
+    return slot >= 0 ? &map->values[slot] : &missing;
+}
+
+extern "C"
+BeeMap* bee_map_new()
+{
+    BeeMap* map = (BeeMap*)checked(malloc(sizeof(BeeMap)));
+    allocate(map, GROUP);
+    map->count = 0;
+    return map;
+}
+
+/* Frees the table and the copies of its keys, string values belong to whoever made them */
+template <typename K>
+static void release(BeeMap* map)
+{
+    for (long long i = 0; i < map->capacity; i++) {
+        if (map->control[i] != EMPTY)
+            K::release(map->keys[i]);
+    }
+    free(map->control);
+    free(map->keys);
+    free(map->values);
+    free(map);
+}
+
+extern "C"
+void bee_map_free_int(BeeMap* map)
+{
+    release<IntKeys>(map);
+}
+
+extern "C"
+void bee_map_free_string(BeeMap* map)
+{
+    release<StringKeys>(map);
+}
+
+extern "C"
+void* bee_map_get_int(BeeMap* map, long long key)
+{
+    return get<IntKeys>(map, key);
+}
+
+extern "C"
+void* bee_map_get_string(BeeMap* map, const char* key)
+{
+    return get<StringKeys>(map, key);
+}
+
+extern "C"
+void* bee_map_put_int(BeeMap* map, long long key)
+{
+    return put<IntKeys>(map, key);
+}
+
+extern "C"
+void* bee_map_put_string(BeeMap* map, const char* key)
+{
+    return put<StringKeys>(map, key);
+}
+
+extern "C"
+bool bee_map_contains_int(BeeMap* map, long long key)
+{
+    return findSlot<IntKeys>(map, key, IntKeys::hash(key)) >= 0;
+}
+
+extern "C"
+bool bee_map_contains_string(BeeMap* map, const char* key)
+{
+    return findSlot<StringKeys>(map, key, StringKeys::hash(key)) >= 0;
+}
+
+extern "C"
+long long bee_map_len(BeeMap* map)
+{
+    return map->count;
+}
+
+/* Iteration in slot order. Writes the key of the next entry at or after
+   cursor and moves cursor past it, false once there are no more */
+extern "C"
+bool bee_map_next(BeeMap* map, long long* cursor, unsigned long long* key)
+{
+    for (long long i = *cursor; i < map->capacity; i++) {
+        if (map->control[i] != EMPTY) {
+            *key = map->keys[i];
+            *cursor = i + 1;
+            return true;
+        }
+    }
+    *cursor = map->capacity;
+    return false;
+}
@@ -0,0 +1,209 @@
+#include "node.h"
+#include "codegen.h"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/IR/DebugInfo.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+using namespace std;
+
+int runClang(const std::vector<const char*>& args);
+
+/* `bee build --incremental` compiles every function of a program into its own
+   object, named by a hash of everything that goes into it: its IR, the
+   declarations of what it calls, the bodies of the functions it may inline
+   and the compiler itself. Objects already in the cache are reused, so only
+   changed functions and the callers that inline them are optimized and
+   emitted again, then all of them are linked into out.o */
+
+/* Collects the globals a function body or initializer refers to, looking through constant expressions */
+static void collectReferences(const User* user, std::vector<const GlobalValue*>& found, std::set<const Constant*>& seen)
+{
+	for (const Use& operand : user->operands()) {
+		if (const GlobalValue* global = dyn_cast<GlobalValue>(operand.get())) {
+			found.push_back(global);
+		} else if (const Constant* constant = dyn_cast<Constant>(operand.get())) {
+			if (seen.insert(constant).second)
+				collectReferences(constant, found, seen);
+		}
+	}
+}
+
+/* Copies one function into a module of its own. Everything it refers to is
+   declared, local helpers and string constants are copied along, and the
+   functions it calls come with their bodies as available_externally so
+   they can still be inlined. Constants are left unnamed, so the text of
+   the unit does not depend on how many strings other functions have */
+static std::unique_ptr<Module> extractUnit(CodeGenContext& context, Function& root)
+{
+	std::unique_ptr<Module> unit(new Module("unit", context.llvmContext));
+	unit->setTargetTriple(context.module->getTargetTriple());
+	unit->setDataLayout(context.module->getDataLayout());
+
+	ValueToValueMapTy map;
+	std::vector<const GlobalValue*> bodies;
+	std::vector<const GlobalValue*> pending = { &root };
+	std::set<const Constant*> seen;
+	std::set<const GlobalValue*> callees;
+	while (!pending.empty()) {
+		const GlobalValue* value = pending.back();
+		pending.pop_back();
+		if (map.count(value))
+			continue;
+
+		/* Generators are split into coroutines where they are defined, so they are never inlined here */
+		bool body = !value->isDeclaration() && (value == &root || value->hasLocalLinkage()
+				|| (callees.count(value) && isa<Function>(value) && !context.generators.count(value->getName().str())));
+		if (const Function* function = dyn_cast<Function>(value)) {
+			Function* copy = Function::Create(function->getFunctionType(), function->getLinkage(),
+					function->getAddressSpace(), function->getName(), unit.get());
+			copy->copyAttributesFrom(function);
+			map[function] = copy;
+		} else if (const GlobalVariable* global = dyn_cast<GlobalVariable>(value)) {
+			body = body || (root.getName() == "main" && !global->isDeclaration());
+			GlobalVariable* copy = new GlobalVariable(*unit, global->getValueType(), global->isConstant(),
+					body ? global->getLinkage() : GlobalValue::ExternalLinkage, nullptr,
+					global->hasLocalLinkage() ? "" : global->getName());
+			copy->copyAttributesFrom(global);
+			map[global] = copy;
+		} else {
+			continue;
+		}
+		if (!body)
+			continue;
+
+		bodies.push_back(value);
+		std::vector<const GlobalValue*> found;
+		if (const Function* function = dyn_cast<Function>(value)) {
+			for (const BasicBlock& block : *function)
+				for (const Instruction& inst : block)
+					collectReferences(&inst, found, seen);
+		} else {
+			collectReferences(cast<GlobalVariable>(value), found, seen);
+		}
+		/* Only the root's own callees bring their bodies for inlining */
+		if (value == &root)
+			callees.insert(found.begin(), found.end());
+		pending.insert(pending.end(), found.rbegin(), found.rend());
+	}
+
+	for (const GlobalValue* value : bodies) {
+		if (const Function* function = dyn_cast<Function>(value)) {
+			Function* copy = cast<Function>(map[function]);
+			Function::arg_iterator argument = copy->arg_begin();
+			for (const Argument& original : function->args()) {
+				argument->setName(original.getName());
+				map[&original] = &*argument++;
+			}
+			SmallVector<ReturnInst*, 8> returns;
+			CloneFunctionInto(copy, function, map, CloneFunctionChangeType::DifferentModule, returns);
+			if (function != &root && !function->hasLocalLinkage())
+				copy->setLinkage(GlobalValue::AvailableExternallyLinkage);
+		} else {
+			const GlobalVariable* global = cast<GlobalVariable>(value);
+			cast<GlobalVariable>(map[global])->setInitializer(MapValue(global->getInitializer(), map));
+		}
+	}
+	return unit;
+}
+
+static bool emitObject(CodeGenContext& context, Module& unit, const std::string& path)
+{
+	/* Written aside and renamed, so an interrupted build leaves no half object in the cache */
+	std::string temporary = path + ".tmp";
+	std::error_code ec;
+	raw_fd_ostream out(temporary, ec, sys::fs::OF_None);
+	if (ec) {
+		context.error("cannot write " + temporary + ": " + ec.message());
+		return false;
+	}
+	legacy::PassManager pm;
+	if (context.machine->addPassesToEmitFile(pm, out, nullptr, CGFT_ObjectFile)) {
+		context.error("the host target cannot emit object files");
+		return false;
+	}
+	pm.run(unit);
+	out.close();
+	if ((ec = sys::fs::rename(temporary, path))) {
+		context.error("cannot write " + path + ": " + ec.message());
+		return false;
+	}
+	return true;
+}
+
+/* Builds out.o from cached objects, returns how many had to be rebuilt or -1 */
+int CodeGenContext::compileIncremental(const std::string& cache, int& total)
+{
+	if (!machine) {
+		error("incremental builds need a target for the host");
+		return -1;
+	}
+	std::error_code ec = sys::fs::create_directories(cache);
+	if (ec) {
+		error("cannot create " + cache + ": " + ec.message());
+		return -1;
+	}
+
+	/* Line numbers would make every function after an edit look changed */
+	StripDebugInfo(*module);
+
+	/* Units call each other's functions, so those stay external, but under a
+	   bee. prefix and hidden, so a BEE function named like a C library one
+	   cannot take its place and nothing outside out.o links against them */
+	for (Function& function : *module) {
+		if (function.isDeclaration() || function.hasLocalLinkage() || function.getName() == "main")
+			continue;
+		std::string name = function.getName().str();
+		if (generators.erase(name))
+			generators.insert("bee." + name);
+		function.setName("bee." + name);
+		function.setVisibility(GlobalValue::HiddenVisibility);
+	}
+
+	/* A new bee binary may generate or optimize differently */
+	std::string compiler;
+	std::string executable = sys::fs::getMainExecutable(nullptr, (void*)&runClang);
+	sys::fs::file_status status;
+	if (!sys::fs::status(executable, status))
+		compiler = executable + " " + std::to_string(status.getLastModificationTime().time_since_epoch().count());
+	compiler += " " + machine->getTargetCPU().str() + " " + machine->getTargetFeatureString().str();
+
+	int rebuilt = 0;
+	total = 0;
+	std::vector<std::string> objects;
+	for (Function& function : *module) {
+		if (function.isDeclaration() || function.hasLocalLinkage())
+			continue;
+		std::unique_ptr<Module> unit = extractUnit(*this, function);
+
+		std::string text;
+		raw_string_ostream stream(text);
+		unit->print(stream, nullptr);
+		stream << compiler;
+		std::string path = cache + "/" + toHex(SHA1::hash(arrayRefFromStringRef(stream.str())), true) + ".o";
+		objects.push_back(path);
+		total++;
+		if (sys::fs::exists(path))
+			continue;
+
+		optimize(*unit);
+		for (Function& copy : *unit) {
+			if (copy.hasAvailableExternallyLinkage())
+				copy.deleteBody();
+		}
+		if (!emitObject(*this, *unit, path))
+			return -1;
+		rebuilt++;
+	}
+
+	std::vector<const char*> args = { "clang++", "-r", "-o", "out.o" };
+	for (const std::string& object : objects)
+		args.push_back(object.c_str());
+	if (runClang(args) != 0) {
+		error("linking out.o failed");
+		return -1;
+	}
+	return rebuilt;
+}
@@ -1,31 +1,81 @@
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include "codegen.h"
 #include "node.h"
 
 using namespace std;
 
-bool JIT = false;
+void createCoreFunctions(CodeGenContext& context);
+int serve();
+int forward(int argc, char **argv);
+int batch(int argc, char **argv);
 
-extern int yyparse();
-extern NBlock* programBlock;
+void initializeLLVM()
+{
+	InitializeAllTargetInfos();
+	InitializeAllTargets();
+	InitializeAllTargetMCs();
+	InitializeAllAsmParsers();
+	InitializeAllAsmPrinters();
+}
 
-void createCoreFunctions(CodeGenContext& context);
+static int failure(const std::vector<std::string>& errors)
+{
+	printf("\x1B[91mFAILURE\033[0m\n");
+	for (const std::string& message : errors)
+		std::cerr << "[\x1B[91mERROR\033[0m]: " << message << endl;
+	return 1;
+}
 
-int main(int argc, char **argv)
+/* Runs or compiles a program, expects LLVM to be initialized */
+int beeMain(int argc, char **argv)
 {
-	FILE* fp;
+	FILE* input = stdin;
+	bool JIT = false;
+	bool incremental = false;
+	const char* path = NULL;
+	std::string remarksFile, remarksFilter;
+
+	if (argc > 1 && !strcmp(argv[1], "batch"))
+		return batch(argc, argv);
+
+	/* --remarks=out.yaml, --remarks-filter=regex and --incremental may go anywhere on the line */
+	std::vector<char*> args;
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--incremental"))
+			incremental = true;
+		else if (!strncmp(argv[i], "--remarks=", 10))
+			remarksFile = argv[i] + 10;
+		else if (!strncmp(argv[i], "--remarks-filter=", 17))
+			remarksFilter = argv[i] + 17;
+		else
+			args.push_back(argv[i]);
+	}
+	argc = args.size();
+	args.push_back(NULL);
+	argv = args.data();
 
 	if (argc > 1) {
 		if (!strcmp(argv[1], "run")) {
 			JIT = true;
-			fp = freopen(argv[2], "r", stdin);
+			path = argv[2];
+		} else if (!strcmp(argv[1], "build")) {
+			path = argv[2];
 		} else {
-			fp = freopen(argv[1], "r", stdin);
+			path = argv[1];
 		}
 	}
 
 	printf("[\x1B[94mBEE\033[0m]: Parsing Code...        ");
-	yyparse();
+	if (path != NULL && (input = fopen(path, "r")) == NULL)
+		return failure({std::string("cannot open ") + path});
+	std::string error;
+	NBlock* programBlock = parseFile(input, error);
+	if (input != stdin)
+		fclose(input);
+	if (programBlock == NULL)
+		return failure({error});
 	printf("\x1B[92mSUCCESS\033[0m\n");
 
 	#if DEBUG == true
@@ -34,32 +84,99 @@ int main(int argc, char **argv)
 	
 	printf("[\x1B[94mBEE\033[0m]: Generating Bytecode... ");
 
-	InitializeAllTargetInfos();
-	InitializeAllTargets();
-	InitializeAllTargetMCs();
-	InitializeAllAsmParsers();
-	InitializeAllAsmPrinters();
-
-	CodeGenContext context;
+	LLVMContext llvmContext;
+	CodeGenContext context(llvmContext);
+	context.sourceFile = path != NULL ? path : "<stdin>";
+	context.remarksFile = remarksFile;
+	context.remarksFilter = remarksFilter;
+	/* Incremental objects call each other's functions, so they are exported */
+	if (incremental && !JIT) {
+		context.incremental = true;
+		context.functionLinkage = GlobalValue::ExternalLinkage;
+	}
 	createCoreFunctions(context);
 	context.generateCode(*programBlock);
+	/* The module no longer needs the AST, and watch parses again on every save */
+	delete programBlock;
 
+	if (!context.errors.empty())
+		return failure(context.errors);
 	printf("\x1B[92mSUCCESS\033[0m\n");
 
 	if (JIT) {
 		printf("[\x1B[94mBEE\033[0m]: Running Code\n");
 		context.runCode();
 		printf("[\x1B[94mBEE\033[0m]: Code Finished\n");
+	} else if (context.incremental) {
+		printf("[\x1B[94mBEE\033[0m]: Compiling Objects...   ");
+		int total;
+		int rebuilt = context.compileIncremental(".bee-cache", total);
+		if (rebuilt < 0)
+			return failure(context.errors);
+		printf("\x1B[92mSUCCESS\033[0m (%d of %d functions rebuilt)\n", rebuilt, total);
 	} else {
 		printf("[\x1B[94mBEE\033[0m]: Compiling Objects...   ");
-		context.compileCode();
+		if (context.compileCode() != 0)
+			return failure(context.errors);
 		printf("\x1B[92mSUCCESS\033[0m\n");
 	}
 	
 	printf("[\x1B[94mBEE\033[0m]: \x1B[95mExiting\033[0m\n");
 
-	fclose(fp);
+	return 0;
+}
 
+/* `bee watch code.b`: an incremental build every time code.b is saved, until interrupted */
+static int watch(int argc, char **argv)
+{
+	if (argc < 3) {
+		std::cerr << "[\x1B[91mERROR\033[0m]: usage: bee watch code.b" << endl;
+		return 1;
+	}
+	char* args[] = { argv[0], (char*)"build", (char*)"--incremental", argv[2], NULL };
+	sys::TimePoint<> built;
+	while (true) {
+		sys::fs::file_status status;
+		if (!sys::fs::status(argv[2], status) && status.getLastModificationTime() != built) {
+			built = status.getLastModificationTime();
+			beeMain(4, args);
+			fflush(stdout);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
 	return 0;
 }
 
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "serve"))
+		return serve();
+	/* Runs here rather than in a server, it never finishes */
+	if (argc > 1 && !strcmp(argv[1], "watch")) {
+		initializeLLVM();
+		return watch(argc, argv);
+	}
+
+	/* Hand the work to a resident server, only when asked to with
+	   --server or BEE_SOCKET. Without one listening it runs here */
+	bool server = getenv("BEE_SOCKET") != NULL;
+	std::vector<char*> args;
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--server"))
+			server = true;
+		else
+			args.push_back(argv[i]);
+	}
+	argc = args.size();
+	args.push_back(NULL);
+	argv = args.data();
+	if (server) {
+		int status = forward(argc, argv);
+		if (status >= 0)
+			return status;
+	}
+
+	initializeLLVM();
+	return beeMain(argc, argv);
+}
+
@@ -1,8 +1,304 @@
 #include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <ctime>
+#include <unistd.h>
+
+#define BUFFER_SIZE (1 << 16)
+
+/* Per-thread output buffer, flushed when full and at thread/program exit,
+   and after every line when stdout is a terminal so prompts show up before
+   the program waits for input. Flushes go to stdout, or to the capture
+   string while one is set */
+class OutputBuffer {
+public:
+    char data[BUFFER_SIZE];
+    size_t length = 0;
+    std::string* capture = NULL;
+
+    ~OutputBuffer() { flush(); }
+
+    void flush()
+    {
+        if (capture != NULL) {
+            capture->append(data, length);
+            length = 0;
+            return;
+        }
+        if (length > 0) {
+            fwrite(data, 1, length, stdout);
+            length = 0;
+        }
+        fflush(stdout);
+    }
+
+    char* reserve(size_t size)
+    {
+        if (length + size > BUFFER_SIZE)
+            flush();
+        return data + length;
+    }
+
+    void write(const char* str, size_t size)
+    {
+        if (size > BUFFER_SIZE) {
+            flush();
+            if (capture != NULL)
+                capture->append(str, size);
+            else
+                fwrite(str, 1, size, stdout);
+            return;
+        }
+        memcpy(reserve(size), str, size);
+        length += size;
+    }
+
+    void put(char c)
+    {
+        *reserve(1) = c;
+        length++;
+    }
+
+    void endLine()
+    {
+        put('\n');
+        if (capture == NULL && interactive)
+            flush();
+    }
+
+    static const bool interactive;
+};
+
+const bool OutputBuffer::interactive = isatty(fileno(stdout));
+
+static thread_local OutputBuffer output;
+
+/* Wall clock in nanoseconds, comparable across processes */
+extern "C"
+long long bee_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+extern "C"
+void bee_flush()
+{
+    output.flush();
+}
+
+/* Called when the heap runs out, what was printed so far still comes out */
+extern "C"
+void bee_out_of_memory()
+{
+    output.flush();
+    fputs("out of memory\n", stderr);
+    exit(1);
+}
+
+/* Redirects this thread's output into a string, NULL goes back to stdout */
+void bee_capture(std::string* capture)
+{
+    output.flush();
+    output.capture = capture;
+}
+
+extern "C"
+void bee_write(const char* str, long long size)
+{
+    output.write(str, size);
+}
+
+extern "C"
+void bee_newline()
+{
+    output.endLine();
+}
+
+static int writeDecimal(unsigned long long n, bool negative)
+{
+    char digits[20];
+    char* out = output.reserve(21);
+    char* end = out;
+    int count = 0;
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    if (negative)
+        *end++ = '-';
+    while (count > 0)
+        *end++ = digits[--count];
+    output.length += end - out;
+    return end - out;
+}
+
+/* The writers printf is split into return how many bytes they wrote, as printf does */
+extern "C"
+int bee_print_int(long long val)
+{
+    return writeDecimal(val < 0 ? 0ULL - val : val, val < 0);
+}
+
+extern "C"
+int bee_print_uint(unsigned long long val)
+{
+    return writeDecimal(val, false);
+}
 
 extern "C"
 void printi(long long val)
 {
-    printf("%lld\n", val);
+    bee_print_int(val);
+    output.endLine();
+}
+
+extern "C"
+int bee_print_char(long long val)
+{
+    output.put((char)val);
+    return 1;
+}
+
+extern "C"
+void bee_print_bool(bool val)
+{
+    if (val)
+        output.write("true", 4);
+    else
+        output.write("false", 5);
+}
+
+extern "C"
+int bee_print_string(const char* str)
+{
+    size_t size = strlen(str);
+    output.write(str, size);
+    return size;
+}
+
+extern "C"
+int bee_print_double(double val)
+{
+    int size = snprintf(output.reserve(32), 32, "%g", val);
+    output.length += size;
+    return size;
+}
+
+/* Fixed-point form used by "%f" and "%.Nf" format specifiers */
+extern "C"
+int bee_print_fixed(double val, long long precision)
+{
+    char* out = output.reserve(64);
+    int size = snprintf(out, 64, "%.*f", (int)precision, val);
+    if (size < 64) {
+        output.length += size;
+        return size;
+    }
+    std::string wide(size + 1, '\0');
+    snprintf(&wide[0], size + 1, "%.*f", (int)precision, val);
+    output.write(wide.data(), size);
+    return size;
+}
+
+/* Fallback for formats that could not be split at compile time */
+extern "C"
+int bee_printf(const char* format, ...)
+{
+    va_list args, copy;
+    va_start(args, format);
+    va_copy(copy, args);
+    size_t room = BUFFER_SIZE - output.length;
+    int size = vsnprintf(output.data + output.length, room, format, args);
+    if (size >= 0 && (size_t)size < room) {
+        output.length += size;
+    } else if (size >= 0) {
+        std::string wide(size + 1, '\0');
+        vsnprintf(&wide[0], size + 1, format, copy);
+        output.write(wide.data(), size);
+    }
+    va_end(copy);
+    va_end(args);
+    return size;
 }
 
+extern "C"
+void bee_print_ints(long long* arr, long long count)
+{
+    output.put('[');
+    for (long long i = 0; i < count; i++) {
+        if (i > 0)
+            output.write(", ", 2);
+        bee_print_int(arr[i]);
+    }
+    output.put(']');
+}
+
+extern "C"
+void bee_print_doubles(double* arr, long long count)
+{
+    output.put('[');
+    for (long long i = 0; i < count; i++) {
+        if (i > 0)
+            output.write(", ", 2);
+        bee_print_double(arr[i]);
+    }
+    output.put(']');
+}
+
+/* Arrays of the narrow integer types, size is the element width in bytes */
+extern "C"
+void bee_print_intv(const void* arr, long long count, long long size, bool sign)
+{
+    output.put('[');
+    for (long long i = 0; i < count; i++) {
+        if (i > 0)
+            output.write(", ", 2);
+        switch (size) {
+            case 1: sign ? bee_print_int(((const signed char*)arr)[i]) : bee_print_uint(((const unsigned char*)arr)[i]); break;
+            case 2: sign ? bee_print_int(((const short*)arr)[i]) : bee_print_uint(((const unsigned short*)arr)[i]); break;
+            case 4: sign ? bee_print_int(((const int*)arr)[i]) : bee_print_uint(((const unsigned int*)arr)[i]); break;
+            default: sign ? bee_print_int(((const long long*)arr)[i]) : bee_print_uint(((const unsigned long long*)arr)[i]); break;
+        }
+    }
+    output.put(']');
+}
+
+extern "C"
+void bee_print_floats(float* arr, long long count)
+{
+    output.put('[');
+    for (long long i = 0; i < count; i++) {
+        if (i > 0)
+            output.write(", ", 2);
+        bee_print_double(arr[i]);
+    }
+    output.put(']');
+}
+
+extern "C"
+void bee_print_bools(bool* arr, long long count)
+{
+    output.put('[');
+    for (long long i = 0; i < count; i++) {
+        if (i > 0)
+            output.write(", ", 2);
+        bee_print_bool(arr[i]);
+    }
+    output.put(']');
+}
+
+extern "C"
+void bee_print_strings(const char** arr, long long count)
+{
+    output.put('[');
+    for (long long i = 0; i < count; i++) {
+        if (i > 0)
+            output.write(", ", 2);
+        bee_print_string(arr[i]);
+    }
+    output.put(']');
+}
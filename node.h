@@ -1,22 +1,45 @@
+#include <cstdio>
 #include <iostream>
 #include <vector>
 #include <llvm/IR/Value.h>
 
 class CodeGenContext;
+class NBlock;
 class NStatement;
 class NExpression;
 class NVariableDeclaration;
+class NSwitchCase;
 
 typedef std::vector<NStatement*> StatementList;
 typedef std::vector<NExpression*> ExpressionList;
 typedef std::vector<NVariableDeclaration*> VariableList;
+typedef std::vector<NSwitchCase*> CaseList;
+
+/* Defined in tokens.l, return NULL and set error on a syntax error */
+NBlock* parseFile(FILE* file, std::string& error);
+NBlock* parseString(const std::string& source, std::string& error);
 
 class Node {
 public:
+	/* Where the node starts in the source, 1 based. The parser sets
+	   nextLine and nextColumn before each rule's action creates its nodes */
+	int line;
+	int column;
+	static thread_local int nextLine;
+	static thread_local int nextColumn;
+	Node() : line(nextLine), column(nextColumn) { }
 	virtual ~Node() {}
 	virtual llvm::Value* codeGen(CodeGenContext& context) { return NULL; }
 };
 
+/* Every node owns the nodes it refers to, so deleting the root frees a whole program */
+template <typename T>
+void deleteNodes(const std::vector<T*>& nodes)
+{
+	for (Node* node : nodes)
+		delete node;
+}
+
 class NExpression : public Node {
 };
 
@@ -65,13 +88,17 @@ public:
 	NMethodCall(const NIdentifier& id, ExpressionList& arguments) :
 		id(id), arguments(arguments) { }
 	NMethodCall(const NIdentifier& id) : id(id) { }
+	virtual ~NMethodCall() { delete &id; deleteNodes(arguments); }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
 class NArray : public NExpression {
 public:
 	ExpressionList items;
+	/* Element type, given by the variable or parameter the array is assigned to */
+	std::string type;
 	NArray(ExpressionList& items) : items(items) { }
+	virtual ~NArray() { deleteNodes(items); }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -81,6 +108,7 @@ public:
 	NExpression& index;
 	NArrayRead(const std::string& arr, NExpression& index) : 
 		arr(arr), index(index) { }
+	virtual ~NArrayRead() { delete &index; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -91,9 +119,38 @@ public:
 	NExpression& assignment;
 	int op;
 	NArrayWrite(const std::string& arr, NExpression& index, NExpression& assignment) : 
-		arr(arr), index(index), assignment(assignment) { }
+		arr(arr), index(index), assignment(assignment), op(0) { }
 	NArrayWrite(const std::string& arr, NExpression& index, int op, NExpression& assignment) : 
 		arr(arr), index(index), assignment(assignment), op(op) { }
+	virtual ~NArrayWrite() { delete &index; delete &assignment; }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* A struct field, either of a struct variable (index is NULL)
+   or of one element of an array of structs */
+class NFieldRead : public NExpression {
+public:
+	std::string base;
+	NExpression *index;
+	std::string field;
+	NFieldRead(const std::string& base, NExpression *index, const std::string& field) :
+		base(base), index(index), field(field) { }
+	virtual ~NFieldRead() { delete index; }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+class NFieldWrite : public NExpression {
+public:
+	std::string base;
+	NExpression *index;
+	std::string field;
+	NExpression& assignment;
+	int op;
+	NFieldWrite(const std::string& base, NExpression *index, const std::string& field, NExpression& assignment) :
+		base(base), index(index), field(field), assignment(assignment), op(0) { }
+	NFieldWrite(const std::string& base, NExpression *index, const std::string& field, int op, NExpression& assignment) :
+		base(base), index(index), field(field), assignment(assignment), op(op) { }
+	virtual ~NFieldWrite() { delete index; delete &assignment; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -104,6 +161,7 @@ public:
 	NExpression& rhs;
 	NBinaryOperator(NExpression& lhs, int op, NExpression& rhs) :
 		lhs(lhs), rhs(rhs), op(op) { }
+	virtual ~NBinaryOperator() { delete &lhs; delete &rhs; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -113,6 +171,7 @@ public:
 	NExpression& expr;
 	NUnaryOperator(int op, NExpression& expr) :
 		op(op), expr(expr) { }
+	virtual ~NUnaryOperator() { delete &expr; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -122,9 +181,10 @@ public:
 	NIdentifier& lhs;
 	NExpression& rhs;
 	NAssignment(NIdentifier& lhs, NExpression& rhs) : 
-		lhs(lhs), rhs(rhs) { }
+		lhs(lhs), rhs(rhs), op(0) { }
 	NAssignment(NIdentifier& lhs, int op, NExpression& rhs) : 
 		lhs(lhs), rhs(rhs), op(op) { }
+	virtual ~NAssignment() { delete &lhs; delete &rhs; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -132,6 +192,7 @@ class NBlock : public NExpression {
 public:
 	StatementList statements;
 	NBlock() { }
+	virtual ~NBlock() { deleteNodes(statements); }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -140,6 +201,7 @@ public:
 	NExpression& expression;
 	NExpressionStatement(NExpression& expression) : 
 		expression(expression) { }
+	virtual ~NExpressionStatement() { delete &expression; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -148,6 +210,17 @@ public:
 	NExpression& expression;
 	NReturnStatement(NExpression& expression) : 
 		expression(expression) { }
+	virtual ~NReturnStatement() { delete &expression; }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* Hands a value to the for loop iterating the generator and suspends it */
+class NYieldStatement : public NStatement {
+public:
+	NExpression& expression;
+	NYieldStatement(NExpression& expression) : 
+		expression(expression) { }
+	virtual ~NYieldStatement() { delete &expression; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -160,6 +233,7 @@ public:
 		type(type), id(id) { assignmentExpr = NULL; }
 	NVariableDeclaration(const NIdentifier& type, NIdentifier& id, NExpression *assignmentExpr) :
 		type(type), id(id), assignmentExpr(assignmentExpr) { }
+	virtual ~NVariableDeclaration() { delete &type; delete &id; delete assignmentExpr; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -168,10 +242,25 @@ public:
 	const NIdentifier& type;
 	NIdentifier& id;
 	NExpression *assignmentExpr;
+	NExpression *size;
+	std::string layout;
 	NArrayDeclaration(const NIdentifier& type, NIdentifier& id) :
-		type(type), id(id) { assignmentExpr = NULL; }
+		type(type), id(id), size(NULL) { assignmentExpr = NULL; }
 	NArrayDeclaration(const NIdentifier& type, NIdentifier& id, NExpression *assignmentExpr) :
-		type(type), id(id), assignmentExpr(assignmentExpr) { }
+		type(type), id(id), assignmentExpr(assignmentExpr), size(NULL) { }
+	NArrayDeclaration(const NIdentifier& type, NIdentifier& id, NExpression& size, const std::string& layout) :
+		type(type), id(id), assignmentExpr(NULL), size(&size), layout(layout) { }
+	virtual ~NArrayDeclaration() { delete &type; delete &id; delete assignmentExpr; delete size; }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+class NStructDeclaration : public NStatement {
+public:
+	const NIdentifier& id;
+	VariableList fields;
+	NStructDeclaration(const NIdentifier& id, const VariableList& fields) :
+		id(id), fields(fields) { }
+	virtual ~NStructDeclaration() { delete &id; deleteNodes(fields); }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -180,9 +269,14 @@ public:
     const NIdentifier& type;
     const NIdentifier& id;
     VariableList arguments;
+    std::vector<std::string> attributes;
     NExternDeclaration(const NIdentifier& type, const NIdentifier& id,
             const VariableList& arguments) :
         type(type), id(id), arguments(arguments) {}
+    NExternDeclaration(const NIdentifier& type, const NIdentifier& id,
+            const VariableList& arguments, const std::vector<std::string>& attributes) :
+        type(type), id(id), arguments(arguments), attributes(attributes) {}
+    virtual ~NExternDeclaration() { delete &type; delete &id; deleteNodes(arguments); }
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -192,9 +286,14 @@ public:
 	const NIdentifier& id;
 	VariableList arguments;
 	NBlock& block;
+	std::vector<std::string> attributes;
 	NFunctionDeclaration(const NIdentifier& type, const NIdentifier& id, 
 			const VariableList& arguments, NBlock& block) :
 		type(type), id(id), arguments(arguments), block(block) { }
+	NFunctionDeclaration(const NIdentifier& type, const NIdentifier& id, 
+			const VariableList& arguments, NBlock& block, const std::vector<std::string>& attributes) :
+		type(type), id(id), arguments(arguments), block(block), attributes(attributes) { }
+	virtual ~NFunctionDeclaration() { delete &type; delete &id; deleteNodes(arguments); delete &block; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -205,6 +304,7 @@ public:
 	NBlock& elseblock;
 	NConditional(NExpression& condition, NBlock& thenblock, NBlock& elseblock) :
 		condition(condition), thenblock(thenblock), elseblock(elseblock) { }
+	virtual ~NConditional() { delete &condition; delete &thenblock; delete &elseblock; }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -214,5 +314,39 @@ public:
 	NBlock& block;
 	NLoop(NExpression& condition, NBlock& block) :
 		condition(condition), block(block) { }
+	virtual ~NLoop() { delete &condition; delete &block; }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* for x in gen(...) { }, runs the block once per value the generator yields */
+class NForIn : public NStatement {
+public:
+	NIdentifier& id;
+	NExpression& generator;
+	NBlock& block;
+	NForIn(NIdentifier& id, NExpression& generator, NBlock& block) :
+		id(id), generator(generator), block(block) { }
+	virtual ~NForIn() { delete &id; delete &generator; delete &block; }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* One arm of a switch, an arm without values is the default */
+class NSwitchCase : public Node {
+public:
+	ExpressionList values;
+	NBlock& block;
+	NSwitchCase(const ExpressionList& values, NBlock& block) :
+		values(values), block(block) { }
+	virtual ~NSwitchCase() { deleteNodes(values); delete &block; }
+};
+
+/* switch (value) { case 1, 2: ... default: ... }, arms never fall through */
+class NSwitch : public NStatement {
+public:
+	NExpression& value;
+	CaseList cases;
+	NSwitch(NExpression& value, const CaseList& cases) :
+		value(value), cases(cases) { }
+	virtual ~NSwitch() { delete &value; deleteNodes(cases); }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
\ No newline at end of file
@@ -2,12 +2,43 @@
 	#include "node.h"
     #include <cstdio>
     #include <cstdlib>
-	NBlock *programBlock; /* the top level root node of our final AST */
-
-	extern int yylex();
-	void yyerror(const char *s) { std::printf("Error: %s\n", s);std::exit(1); }
 %}
 
+/* The parser is reentrant: every parse gets its own scanner, and hands
+   back its root block and any error through the parse parameters */
+%code requires { typedef void* yyscan_t; }
+%define api.pure full
+%locations
+%lex-param { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { NBlock **programBlock } { std::string *error }
+
+%code {
+	int yylex(YYSTYPE *yylval, YYLTYPE *yylloc, yyscan_t scanner);
+	void yyerror(YYLTYPE *yylloc, yyscan_t scanner, NBlock **programBlock, std::string *error, const char *s) {
+		*error = "line " + std::to_string(yylloc->first_line) + ": " + s;
+	}
+
+	thread_local int Node::nextLine = 0;
+	thread_local int Node::nextColumn = 0;
+
+	/* The default location of a rule spans its symbols, every node
+	   its action creates starts where the rule does */
+	#define YYLLOC_DEFAULT(Current, Rhs, N) \
+		do { \
+			if (N) { \
+				(Current).first_line = YYRHSLOC(Rhs, 1).first_line; \
+				(Current).first_column = YYRHSLOC(Rhs, 1).first_column; \
+				(Current).last_line = YYRHSLOC(Rhs, N).last_line; \
+				(Current).last_column = YYRHSLOC(Rhs, N).last_column; \
+			} else { \
+				(Current).first_line = (Current).last_line = YYRHSLOC(Rhs, 0).last_line; \
+				(Current).first_column = (Current).last_column = YYRHSLOC(Rhs, 0).last_column; \
+			} \
+			Node::nextLine = (Current).first_line; \
+			Node::nextColumn = (Current).first_column; \
+		} while (0)
+}
+
 /* Represents the many different ways we can access our data */
 %union {
 	Node *node;
@@ -18,6 +49,9 @@
 	NVariableDeclaration *var_decl;
 	std::vector<NVariableDeclaration*> *varvec;
 	std::vector<NExpression*> *exprvec;
+	std::vector<std::string> *strvec;
+	NSwitchCase *switch_case;
+	std::vector<NSwitchCase*> *casevec;
 	std::string *string;
 	int token;
 }
@@ -26,16 +60,17 @@
    match our tokens.l lex file. We also define the node type
    they represent.
  */
-%token <string> IDENTIFIER INTEGER DOUBLE STRING
+%token <string> IDENTIFIER INTEGER DOUBLE STRING ATTRIBUTE
 %token <token> CEQ CNE CLT CLE CGT CGE
 %token <token> ASSIGN PLUSASN MINUSASN MULASN DIVASN
-%token <token> IF ELSE WHILE
+%token <token> IF ELSE WHILE FOR IN YIELD STRUCT SWITCH CASE DEFAULT
 %token <token> LPAREN RPAREN LBRACE RBRACE LBRAK RBRAK
-%token <token> ARRID COMMA DOT
+%token <token> ARRID COMMA DOT COLON
 %token <token> PLUS MINUS MUL DIV
 %token <token> NOT
 %token <token> RETURN EXTERN END
 %token <token> TRUE FALSE
+%token <token> UNKNOWN
 
 /* Define the type of node our nonterminal symbols represent.
    The types refer to the %union declaration above. Ex: when
@@ -44,30 +79,38 @@
  */
 %type <ident> ident
 %type <expr> numeric expr
-%type <varvec> func_decl_args
+%type <varvec> func_decl_args struct_fields
 %type <exprvec> call_args
+%type <strvec> attributes
+%type <switch_case> switch_case
+%type <casevec> switch_cases
 %type <block> program stmts block
-%type <stmt> stmt var_decl func_decl extern_decl conditional elseif
+%type <stmt> stmt var_decl func_decl extern_decl struct_decl conditional elseif
 %type <token> comparison
 
-/* Operator precedence for mathematical operators */
+/* Operator precedence, loosest first: assignments take everything to their
+   right, comparisons compare whole sums, and unary operators bind tightest */
+%right ASSIGN PLUSASN MINUSASN MULASN DIVASN
+%left CEQ CNE CLT CLE CGT CGE
 %left PLUS MINUS
 %left MUL DIV
+%right NOT UMINUS
 
 %start program
 
 %%
 
-program : stmts { programBlock = $1; }
+program : stmts { *programBlock = $1; }
 		;
 		
 stmts : stmt { $$ = new NBlock(); $$->statements.push_back($<stmt>1); }
 	  | stmts stmt { $1->statements.push_back($<stmt>2); }
 	  ;
 
-stmt : var_decl END | func_decl | conditional | extern_decl END
+stmt : var_decl END | func_decl | conditional | extern_decl END | struct_decl
 	 | expr END { $$ = new NExpressionStatement(*$1); }
 	 | RETURN expr END { $$ = new NReturnStatement(*$2); }
+	 | YIELD expr END { $$ = new NYieldStatement(*$2); }
      ;
 
 block : LBRACE stmts RBRACE { $$ = $2; }
@@ -82,6 +125,18 @@ conditional : IF LPAREN expr RPAREN block { $$ = new NConditional(*$3, *$5, *(ne
 				$$ = new NConditional(*$3, *$5, *n);
 			 }
 			| WHILE LPAREN expr RPAREN block { $$ = new NLoop(*$3, *$5); } 
+			| FOR ident IN expr block { $$ = new NForIn(*$2, *$4, *$5); }
+			| SWITCH LPAREN expr RPAREN LBRACE switch_cases RBRACE { $$ = new NSwitch(*$3, *$6); delete $6; }
+			;
+
+switch_cases : switch_case { $$ = new CaseList(); $$->push_back($1); }
+			 | switch_cases switch_case { $1->push_back($2); }
+			 ;
+
+switch_case : CASE call_args COLON stmts { $$ = new NSwitchCase(*$2, *$4); delete $2; }
+			| CASE call_args COLON { $$ = new NSwitchCase(*$2, *(new NBlock())); delete $2; }
+			| DEFAULT COLON stmts { $$ = new NSwitchCase(ExpressionList(), *$3); }
+			| DEFAULT COLON { $$ = new NSwitchCase(ExpressionList(), *(new NBlock())); }
 			;
 
 elseif : ELSE IF LPAREN expr RPAREN block { $$ = new NConditional(*$4, *$6, *(new NBlock())); }
@@ -95,17 +150,37 @@ elseif : ELSE IF LPAREN expr RPAREN block { $$ = new NConditional(*$4, *$6, *(ne
 
 var_decl : ident ident { $$ = new NVariableDeclaration(*$1, *$2); }
 		 | ident ident ASSIGN expr { $$ = new NVariableDeclaration(*$1, *$2, $4); }
+		 | ident COLON ident ident { $$ = new NVariableDeclaration(*(new NIdentifier($1->name + ":" + $3->name)), *$4); delete $1; delete $3; }
+		 | ident COLON ident ident ASSIGN expr { $$ = new NVariableDeclaration(*(new NIdentifier($1->name + ":" + $3->name)), *$4, $6); delete $1; delete $3; }
 		 | ident ARRID ident { $$ = new NArrayDeclaration(*$1, *$3); }
 		 | ident ARRID ident ASSIGN expr { $$ = new NArrayDeclaration(*$1, *$3, $5); }
+		 | ident ARRID ident LBRAK expr RBRAK { $$ = new NArrayDeclaration(*$1, *$3, *$5, ""); }
+		 | ident ARRID ident LBRAK expr RBRAK ATTRIBUTE { $$ = new NArrayDeclaration(*$1, *$3, *$5, *$7); delete $7; }
 		 ;
 
+struct_decl : STRUCT ident LBRACE struct_fields RBRACE
+				{ $$ = new NStructDeclaration(*$2, *$4); delete $4; }
+			;
+
+struct_fields : var_decl END { $$ = new VariableList(); $$->push_back($<var_decl>1); }
+			  | struct_fields var_decl END { $1->push_back($<var_decl>2); }
+			  ;
+
 extern_decl : EXTERN ident ident LPAREN func_decl_args RPAREN
                 { $$ = new NExternDeclaration(*$2, *$3, *$5); delete $5; }
+            | attributes EXTERN ident ident LPAREN func_decl_args RPAREN
+                { $$ = new NExternDeclaration(*$3, *$4, *$6, *$1); delete $6; delete $1; }
             ;
 
 func_decl : ident ident LPAREN func_decl_args RPAREN block 
 			{ $$ = new NFunctionDeclaration(*$1, *$2, *$4, *$6); delete $4; }
+		  | attributes ident ident LPAREN func_decl_args RPAREN block
+			{ $$ = new NFunctionDeclaration(*$2, *$3, *$5, *$7, *$1); delete $5; delete $1; }
 		  ;
+
+attributes : ATTRIBUTE { $$ = new std::vector<std::string>(); $$->push_back(*$1); delete $1; }
+		   | attributes ATTRIBUTE { $1->push_back(*$2); delete $2; }
+		   ;
 	
 func_decl_args : /*blank*/  { $$ = new VariableList(); }
 		  | var_decl { $$ = new VariableList(); $$->push_back($<var_decl>1); }
@@ -126,24 +201,36 @@ expr : ident ASSIGN expr { $$ = new NAssignment(*$<ident>1, *$3); }
 	 	| ident DIVASN expr { $$ = new NAssignment(*$<ident>1, $2, *$3); }
 	 | ident LPAREN call_args RPAREN { $$ = new NMethodCall(*$1, *$3); delete $3; }
 	 | ident { $<ident>$ = $1; }
-	 | IDENTIFIER LBRAK expr RBRAK { $$ = new NArrayRead(*$1, *$3); }
-	 | IDENTIFIER LBRAK expr RBRAK ASSIGN expr { $$ = new NArrayWrite(*$1, *$3, *$6); }
-		| IDENTIFIER LBRAK expr RBRAK PLUSASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); }
-		| IDENTIFIER LBRAK expr RBRAK MINUSASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); }
-		| IDENTIFIER LBRAK expr RBRAK MULASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); }
-		| IDENTIFIER LBRAK expr RBRAK DIVASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); }
-	 | LBRAK call_args RBRAK { $$ = new NArray(*$2); }
+	 | IDENTIFIER LBRAK expr RBRAK { $$ = new NArrayRead(*$1, *$3); delete $1; }
+	 | IDENTIFIER LBRAK expr RBRAK ASSIGN expr { $$ = new NArrayWrite(*$1, *$3, *$6); delete $1; }
+		| IDENTIFIER LBRAK expr RBRAK PLUSASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); delete $1; }
+		| IDENTIFIER LBRAK expr RBRAK MINUSASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); delete $1; }
+		| IDENTIFIER LBRAK expr RBRAK MULASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); delete $1; }
+		| IDENTIFIER LBRAK expr RBRAK DIVASN expr { $$ = new NArrayWrite(*$1, *$3, $5, *$6); delete $1; }
+	 | ident DOT ident { $$ = new NFieldRead($1->name, NULL, $3->name); delete $1; delete $3; }
+	 | ident DOT ident ASSIGN expr { $$ = new NFieldWrite($1->name, NULL, $3->name, *$5); delete $1; delete $3; }
+		| ident DOT ident PLUSASN expr { $$ = new NFieldWrite($1->name, NULL, $3->name, $4, *$5); delete $1; delete $3; }
+		| ident DOT ident MINUSASN expr { $$ = new NFieldWrite($1->name, NULL, $3->name, $4, *$5); delete $1; delete $3; }
+		| ident DOT ident MULASN expr { $$ = new NFieldWrite($1->name, NULL, $3->name, $4, *$5); delete $1; delete $3; }
+		| ident DOT ident DIVASN expr { $$ = new NFieldWrite($1->name, NULL, $3->name, $4, *$5); delete $1; delete $3; }
+	 | IDENTIFIER LBRAK expr RBRAK DOT ident { $$ = new NFieldRead(*$1, $3, $6->name); delete $1; delete $6; }
+	 | IDENTIFIER LBRAK expr RBRAK DOT ident ASSIGN expr { $$ = new NFieldWrite(*$1, $3, $6->name, *$8); delete $1; delete $6; }
+		| IDENTIFIER LBRAK expr RBRAK DOT ident PLUSASN expr { $$ = new NFieldWrite(*$1, $3, $6->name, $7, *$8); delete $1; delete $6; }
+		| IDENTIFIER LBRAK expr RBRAK DOT ident MINUSASN expr { $$ = new NFieldWrite(*$1, $3, $6->name, $7, *$8); delete $1; delete $6; }
+		| IDENTIFIER LBRAK expr RBRAK DOT ident MULASN expr { $$ = new NFieldWrite(*$1, $3, $6->name, $7, *$8); delete $1; delete $6; }
+		| IDENTIFIER LBRAK expr RBRAK DOT ident DIVASN expr { $$ = new NFieldWrite(*$1, $3, $6->name, $7, *$8); delete $1; delete $6; }
+	 | LBRAK call_args RBRAK { $$ = new NArray(*$2); delete $2; }
 	 | STRING { $$ = new NString($1->c_str()); delete $1; }
 	 | numeric
          | expr MUL expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
          | expr DIV expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
          | expr PLUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
          | expr MINUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
-		 | MINUS expr { $$ = new NUnaryOperator($1, *$2); }
+		 | MINUS expr %prec UMINUS { $$ = new NUnaryOperator($1, *$2); }
 	 | NOT expr { $$ = new NUnaryOperator($1, *$2); }
 	 | TRUE { $$ = new NBool(true); }
 	 | FALSE { $$ = new NBool(false); }
- 	 | expr comparison expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
+ 	 | expr comparison expr %prec CEQ { $$ = new NBinaryOperator(*$1, $2, *$3); }
      | LPAREN expr RPAREN { $$ = $2; }
 	 ;
 	
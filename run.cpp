@@ -0,0 +1,42 @@
+#include <iostream>
+#include "codegen.h"
+#include "node.h"
+
+using namespace std;
+
+void createCoreFunctions(CodeGenContext& context);
+
+/* bee-run: a quiet JIT-only runner. It links only the host target and
+   MCJIT, and touches LLVM only once the program has parsed */
+int main(int argc, char **argv)
+{
+	if (argc > 1 && freopen(argv[1], "r", stdin) == NULL) {
+		std::cerr << "[\x1B[91mERROR\033[0m]: cannot open " << argv[1] << endl;
+		return 1;
+	}
+
+	std::string error;
+	NBlock* programBlock = parseFile(stdin, error);
+	if (programBlock == NULL) {
+		std::cerr << "[\x1B[91mERROR\033[0m]: " << error << endl;
+		return 1;
+	}
+
+	InitializeNativeTarget();
+	InitializeNativeTargetAsmPrinter();
+
+	LLVMContext llvmContext;
+	CodeGenContext context(llvmContext);
+	createCoreFunctions(context);
+	context.generateCode(*programBlock);
+	delete programBlock;
+
+	if (!context.errors.empty()) {
+		for (const std::string& message : context.errors)
+			std::cerr << "[\x1B[91mERROR\033[0m]: " << message << endl;
+		return 1;
+	}
+	context.runCode();
+
+	return 0;
+}
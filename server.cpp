@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+const char* socketPath();
+bool sameUser(int fd);
+void initializeLLVM();
+int beeMain(int argc, char **argv);
+
+/* Serves a single request in a forked child. The child inherits the
+   already initialized LLVM state and adopts the client's stdio */
+static int handleRequest(int conn)
+{
+	unsigned int size = 0;
+	struct iovec iov = { &size, sizeof(size) };
+
+	int fds[3];
+	char control[CMSG_SPACE(sizeof(fds))];
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(conn, &msg, 0) != sizeof(size))
+		return 1;
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+		return 1;
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	for (int i = 0; i < 3; i++) {
+		dup2(fds[i], i);
+		close(fds[i]);
+	}
+
+	std::string request(size, '\0');
+	for (unsigned int got = 0; got < size; ) {
+		ssize_t n = read(conn, &request[got], size - got);
+		if (n <= 0)
+			return 1;
+		got += n;
+	}
+
+	/* Working directory first, then the client's arguments, each ending in a
+	   NUL. A request that does not end in one is cut short or malformed */
+	if (request.empty() || request.back() != '\0')
+		return 1;
+	std::vector<char*> args;
+	args.push_back((char*)"bee");
+	for (size_t i = request.find('\0') + 1; i < request.size(); i = request.find('\0', i) + 1)
+		args.push_back(&request[i]);
+	args.push_back(NULL);
+
+	if (chdir(request.c_str()) < 0)
+		return 1;
+
+	return beeMain(args.size() - 1, args.data());
+}
+
+/* `bee serve`: stays resident on a Unix socket and forks a child per request,
+   so LLVM is only initialized once and requests run concurrently */
+int serve()
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socketPath(), sizeof(addr.sun_path) - 1);
+
+	/* A stale socket from a server that exited is replaced, a live one is left alone */
+	struct stat info;
+	if (lstat(addr.sun_path, &info) == 0) {
+		if (!S_ISSOCK(info.st_mode) || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+			fprintf(stderr, "[\x1B[91mERROR\033[0m]: %s is in use\n", addr.sun_path);
+			return 1;
+		}
+		close(fd);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || unlink(addr.sun_path) < 0) {
+			perror("unlink");
+			return 1;
+		}
+	}
+
+	/* Only our user may connect, the socket is created private */
+	mode_t mask = umask(077);
+	int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(mask);
+	if (bound < 0 || chmod(addr.sun_path, 0600) < 0 || listen(fd, 128) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	initializeLLVM();
+
+	/* Children are never waited on */
+	signal(SIGCHLD, SIG_IGN);
+
+	printf("[\x1B[94mBEE\033[0m]: Serving on %s\n", addr.sun_path);
+	fflush(stdout);
+
+	for (;;) {
+		int conn = accept(fd, NULL, NULL);
+		if (conn < 0)
+			continue;
+		if (!sameUser(conn)) {
+			close(conn);
+			continue;
+		}
+
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fd);
+			unsigned char status = handleRequest(conn);
+			fflush(stdout);
+			fflush(stderr);
+			if (write(conn, &status, 1) < 0)
+				_exit(1);
+			_exit(0);
+		}
+		close(conn);
+	}
+	return 0;
+}
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/* Sorting and searching for BEE arrays. Every algorithm is a template and
+   each element type gets its own copy, so comparisons compile to one
+   instruction instead of a call. Integers are radix sorted, everything else
+   uses pattern-defeating quicksort, and large arrays are cut into one chunk
+   per core, sorted in parallel and merged */
+
+extern "C" void bee_out_of_memory();
+
+static void* checked(void* memory)
+{
+    if (memory == NULL)
+        bee_out_of_memory();
+    return memory;
+}
+
+static const long long INSERTION = 24;
+static const long long NINTHER = 128;
+static const long long RADIX = 4096;
+static const long long PARALLEL = 1 << 17;
+
+struct Less {
+    template <typename T>
+    bool operator()(T a, T b) const { return a < b; }
+};
+
+struct StringLess {
+    bool operator()(const char* a, const char* b) const { return strcmp(a, b) < 0; }
+};
+
+template <typename T, typename L>
+static void insertionSort(T* begin, T* end, L less)
+{
+    for (T* i = begin + 1; i < end; i++) {
+        T value = *i;
+        T* j = i;
+        for (; j > begin && less(value, *(j - 1)); j--)
+            *j = *(j - 1);
+        *j = value;
+    }
+}
+
+/* Only for ranges with an element no greater than any of theirs right before
+   begin, which stops the scan without a bounds check */
+template <typename T, typename L>
+static void unguardedInsertionSort(T* begin, T* end, L less)
+{
+    for (T* i = begin + 1; i < end; i++) {
+        T value = *i;
+        T* j = i;
+        for (; less(value, *(j - 1)); j--)
+            *j = *(j - 1);
+        *j = value;
+    }
+}
+
+/* Insertion sort that gives up after a few moves, false if it did */
+template <typename T, typename L>
+static bool partialInsertionSort(T* begin, T* end, L less)
+{
+    long long moves = 0;
+    for (T* i = begin + 1; i < end; i++) {
+        T value = *i;
+        T* j = i;
+        for (; j > begin && less(value, *(j - 1)); j--)
+            *j = *(j - 1);
+        *j = value;
+        moves += i - j;
+        if (moves > 8)
+            return false;
+    }
+    return true;
+}
+
+template <typename T, typename L>
+static void sort3(T* a, T* b, T* c, L less)
+{
+    if (less(*b, *a)) std::swap(*a, *b);
+    if (less(*c, *b)) std::swap(*b, *c);
+    if (less(*b, *a)) std::swap(*a, *b);
+}
+
+/* Partitions around the pivot at begin, smaller elements to its left and the
+   rest to its right. Sets partitioned when no element had to move */
+template <typename T, typename L>
+static T* partitionRight(T* begin, T* end, L less, bool& partitioned)
+{
+    T pivot = *begin;
+    T* first = begin;
+    T* last = end;
+
+    /* The median of three left an element no less than the pivot at the end */
+    while (less(*++first, pivot));
+    if (first - 1 == begin)
+        while (first < last && !less(*--last, pivot));
+    else
+        while (!less(*--last, pivot));
+
+    partitioned = first >= last;
+    while (first < last) {
+        std::swap(*first, *last);
+        while (less(*++first, pivot));
+        while (!less(*--last, pivot));
+    }
+
+    T* position = first - 1;
+    *begin = *position;
+    *position = pivot;
+    return position;
+}
+
+/* Puts every element equal to the pivot at begin on its left. Used when the
+   pivot equals the element before the range, then they are all in place */
+template <typename T, typename L>
+static T* partitionLeft(T* begin, T* end, L less)
+{
+    T pivot = *begin;
+    T* first = begin;
+    T* last = end;
+
+    while (less(pivot, *--last));
+    if (last + 1 == end)
+        while (first < last && !less(pivot, *++first));
+    else
+        while (!less(pivot, *++first));
+
+    while (first < last) {
+        std::swap(*first, *last);
+        while (less(pivot, *--last));
+        while (!less(pivot, *++first));
+    }
+
+    *begin = *last;
+    *last = pivot;
+    return last;
+}
+
+/* Pattern-defeating quicksort (Orson Peters). Sorted and reverse sorted runs
+   and many equal elements finish in linear time, a run of bad pivots
+   shuffles the range, and too many of them fall back to heapsort */
+template <typename T, typename L>
+static void pdqsort(T* begin, T* end, L less, int badAllowed, bool leftmost)
+{
+    while (true) {
+        long long size = end - begin;
+        if (size < INSERTION) {
+            if (leftmost)
+                insertionSort(begin, end, less);
+            else
+                unguardedInsertionSort(begin, end, less);
+            return;
+        }
+
+        long long half = size / 2;
+        if (size > NINTHER) {
+            sort3(begin, begin + half, end - 1, less);
+            sort3(begin + 1, begin + (half - 1), end - 2, less);
+            sort3(begin + 2, begin + (half + 1), end - 3, less);
+            sort3(begin + (half - 1), begin + half, begin + (half + 1), less);
+            std::swap(*begin, *(begin + half));
+        } else {
+            sort3(begin + half, begin, end - 1, less);
+        }
+
+        if (!leftmost && !less(*(begin - 1), *begin)) {
+            begin = partitionLeft(begin, end, less) + 1;
+            continue;
+        }
+
+        bool partitioned;
+        T* pivot = partitionRight(begin, end, less, partitioned);
+        long long left = pivot - begin;
+        long long right = end - (pivot + 1);
+
+        if (left < size / 8 || right < size / 8) {
+            if (--badAllowed == 0) {
+                std::make_heap(begin, end, less);
+                std::sort_heap(begin, end, less);
+                return;
+            }
+            if (left >= INSERTION) {
+                std::swap(begin[0], begin[left / 4]);
+                std::swap(pivot[-1], pivot[-left / 4]);
+                if (left > NINTHER) {
+                    std::swap(begin[1], begin[left / 4 + 1]);
+                    std::swap(begin[2], begin[left / 4 + 2]);
+                    std::swap(pivot[-2], pivot[-(left / 4 + 1)]);
+                    std::swap(pivot[-3], pivot[-(left / 4 + 2)]);
+                }
+            }
+            if (right >= INSERTION) {
+                std::swap(pivot[1], pivot[1 + right / 4]);
+                std::swap(end[-1], end[-right / 4]);
+                if (right > NINTHER) {
+                    std::swap(pivot[2], pivot[2 + right / 4]);
+                    std::swap(pivot[3], pivot[3 + right / 4]);
+                    std::swap(end[-2], end[-(1 + right / 4)]);
+                    std::swap(end[-3], end[-(2 + right / 4)]);
+                }
+            }
+        } else if (partitioned && partialInsertionSort(begin, pivot, less)
+                && partialInsertionSort(pivot + 1, end, less)) {
+            return;
+        }
+
+        pdqsort(begin, pivot, less, badAllowed, leftmost);
+        begin = pivot + 1;
+        leftmost = false;
+    }
+}
+
+template <typename T, typename L>
+static void comparisonSort(T* data, long long n, L less)
+{
+    int badAllowed = 1;
+    for (long long size = n; size > 1; size >>= 1)
+        badAllowed++;
+    pdqsort(data, data + n, less, badAllowed, true);
+}
+
+/* LSD radix sort, one byte per pass from the lowest. The sign bit is flipped
+   so negative numbers order first, and passes where every element has the
+   same byte are skipped, so small values in wide types cost few passes */
+template <typename T>
+static void radixSort(T* data, long long n)
+{
+    typedef typename std::make_unsigned<T>::type U;
+    const U flip = std::is_signed<T>::value ? (U)1 << (sizeof(T) * 8 - 1) : 0;
+
+    std::vector<long long> counts(sizeof(T) * 256, 0);
+    for (long long i = 0; i < n; i++) {
+        U key = (U)data[i] ^ flip;
+        for (unsigned int b = 0; b < sizeof(T); b++)
+            counts[b * 256 + ((key >> (b * 8)) & 255)]++;
+    }
+
+    T* buffer = (T*)checked(malloc(n * sizeof(T)));
+    T* from = data;
+    T* to = buffer;
+    for (unsigned int b = 0; b < sizeof(T); b++) {
+        long long* count = &counts[b * 256];
+        if (count[((U)from[0] ^ flip) >> (b * 8) & 255] == n)
+            continue;
+        long long offset = 0;
+        for (int d = 0; d < 256; d++) {
+            long long c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (long long i = 0; i < n; i++)
+            to[count[((U)from[i] ^ flip) >> (b * 8) & 255]++] = from[i];
+        std::swap(from, to);
+    }
+    if (from != data)
+        memcpy(data, from, n * sizeof(T));
+    free(buffer);
+}
+
+template <typename T>
+static void integerSort(T* data, long long n)
+{
+    if (n >= RADIX)
+        radixSort(data, n);
+    else
+        comparisonSort(data, n, Less());
+}
+
+/* Cuts a large array into one chunk per core (a power of two), sorts the
+   chunks on their own threads and merges neighbours in rounds, also in
+   parallel, through a buffer */
+template <typename T, typename S, typename L>
+static void parallelSort(T* data, long long n, S sortChunk, L less)
+{
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (n < PARALLEL || cores < 2) {
+        sortChunk(data, n);
+        return;
+    }
+    long long chunks = 1;
+    while (chunks * 2 <= cores && chunks < 64)
+        chunks *= 2;
+
+    std::vector<long long> bounds(chunks + 1);
+    for (long long i = 0; i <= chunks; i++)
+        bounds[i] = n * i / chunks;
+
+    std::vector<std::thread> workers;
+    for (long long i = 0; i < chunks; i++)
+        workers.emplace_back([=]() { sortChunk(data + bounds[i], bounds[i + 1] - bounds[i]); });
+    for (std::thread& worker : workers)
+        worker.join();
+
+    T* buffer = (T*)checked(malloc(n * sizeof(T)));
+    T* from = data;
+    T* to = buffer;
+    for (long long width = 1; width < chunks; width *= 2) {
+        workers.clear();
+        for (long long i = 0; i < chunks; i += 2 * width) {
+            T* begin = from + bounds[i];
+            T* middle = from + bounds[i + width];
+            T* end = from + bounds[std::min(i + 2 * width, chunks)];
+            T* out = to + bounds[i];
+            workers.emplace_back([=]() { std::merge(begin, middle, middle, end, out, less); });
+        }
+        for (std::thread& worker : workers)
+            worker.join();
+        std::swap(from, to);
+    }
+    if (from != data)
+        memcpy(data, from, n * sizeof(T));
+    free(buffer);
+}
+
+template <typename T>
+static void sortIntegers(T* data, long long n)
+{
+    parallelSort(data, n, integerSort<T>, Less());
+}
+
+template <typename T, typename L>
+static void sortCompared(T* data, long long n)
+{
+    parallelSort(data, n, [](T* chunk, long long size) { comparisonSort(chunk, size, L()); }, L());
+}
+
+/* Index of value in a sorted array, its first copy if there are several, or -1 */
+template <typename T, typename L>
+static long long binarySearch(T* data, long long n, T value, L less)
+{
+    T* found = std::lower_bound(data, data + n, value, less);
+    if (found == data + n || less(value, *found))
+        return -1;
+    return found - data;
+}
+
+/* Moves the elements less than pivot to the front, returns how many there are */
+template <typename T, typename L>
+static long long partitionArray(T* data, long long n, T pivot, L less)
+{
+    return std::partition(data, data + n, [=](T value) { return less(value, pivot); }) - data;
+}
+
+/* Puts the element that belongs at k in a sorted array there, smaller ones
+   before it and larger ones after, and returns it */
+template <typename T, typename L>
+static T nthElement(T* data, long long n, long long k, L less)
+{
+    if (k < 0 || k >= n)
+        return T();
+    std::nth_element(data, data + k, data + n, less);
+    return data[k];
+}
+
+/* The entry points for one element type T. Values cross as W, the widest
+   type of their kind, so the compiler passes every integer as 64 bits */
+#define BEE_SORT_FUNCTIONS(suffix, T, W, sort, L)                                       \
+    extern "C" void bee_sort_##suffix(T* data, long long n)                             \
+    {                                                                                   \
+        if (n > 1)                                                                      \
+            sort(data, n);                                                              \
+    }                                                                                   \
+    extern "C" long long bee_binary_search_##suffix(T* data, long long n, W value)      \
+    {                                                                                   \
+        return binarySearch(data, n, (T)value, L());                                    \
+    }                                                                                   \
+    extern "C" long long bee_partition_##suffix(T* data, long long n, W pivot)          \
+    {                                                                                   \
+        return partitionArray(data, n, (T)pivot, L());                                  \
+    }                                                                                   \
+    extern "C" W bee_nth_element_##suffix(T* data, long long n, long long k)            \
+    {                                                                                   \
+        return nthElement(data, n, k, L());                                             \
+    }
+
+BEE_SORT_FUNCTIONS(i8, signed char, long long, sortIntegers<signed char>, Less)
+BEE_SORT_FUNCTIONS(i16, short, long long, sortIntegers<short>, Less)
+BEE_SORT_FUNCTIONS(i32, int, long long, sortIntegers<int>, Less)
+BEE_SORT_FUNCTIONS(i64, long long, long long, sortIntegers<long long>, Less)
+BEE_SORT_FUNCTIONS(u8, unsigned char, unsigned long long, sortIntegers<unsigned char>, Less)
+BEE_SORT_FUNCTIONS(u16, unsigned short, unsigned long long, sortIntegers<unsigned short>, Less)
+BEE_SORT_FUNCTIONS(u32, unsigned int, unsigned long long, sortIntegers<unsigned int>, Less)
+BEE_SORT_FUNCTIONS(u64, unsigned long long, unsigned long long, sortIntegers<unsigned long long>, Less)
+BEE_SORT_FUNCTIONS(f32, float, double, (sortCompared<float, Less>), Less)
+BEE_SORT_FUNCTIONS(f64, double, double, (sortCompared<double, Less>), Less)
+BEE_SORT_FUNCTIONS(string, const char*, const char*, (sortCompared<const char*, StringLess>), StringLess)
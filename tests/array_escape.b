@@ -0,0 +1,7 @@
+// Copying a sized array into a variable that outlives its block is rejected
+int~ outer = [0];
+int k = 1;
+if (k > 0) {
+    int~ a[5];
+    outer = a;
+}
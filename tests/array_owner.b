@@ -0,0 +1,3 @@
+// A sized array owns its memory, so it cannot be pointed elsewhere
+int~ a[5];
+a = [1, 2];
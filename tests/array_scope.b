@@ -0,0 +1,7 @@
+// A sized array is freed at the end of its block and goes out of scope there
+int k = 1;
+if (k > 0) {
+    int~ a[5];
+    a[0] = 3;
+}
+println(a[0]);
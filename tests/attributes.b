@@ -0,0 +1,17 @@
+// Annotated functions behave like plain ones
+@const int square(int x) {
+    return x * x;
+}
+@pure @noinline int twice(int x) {
+    return square(x) + square(x);
+}
+@inline @hot int add(int a, int b) {
+    return a + b;
+}
+int i = 0;
+int t = 0;
+while (i < 4) {
+    t = add(t, twice(i));
+    i += 1;
+}
+println(t);
@@ -0,0 +1,32 @@
+// Generators hand values to for-in loops one yield at a time
+int range(int n) {
+    int i = 0;
+    while (i < n) {
+        yield i;
+        i += 1;
+    }
+}
+int evens(int n) {
+    for x in range(n) {
+        if (x / 2 * 2 == x) {
+            yield x;
+        }
+    }
+}
+int total = 0;
+for x in range(5) {
+    total += x;
+}
+println(total);
+int sum = 0;
+int count = 0;
+for e in evens(7) {
+    sum += e;
+    count += 1;
+}
+println(sum);
+println(count);
+for x in range(0) {
+    println("never");
+}
+println("done");
@@ -0,0 +1,21 @@
+// Built twice by tests/run.sh, the second time with its lines moved
+int square(int x) {
+    return x * x;
+}
+int cube(int x) {
+    return square(x) * x;
+}
+bool later(int a, int b) {
+    return a > b;
+}
+int abs(int x) {
+    return 1000;
+}
+int~ xs = [4, 1, 3];
+sort_by(xs, 3, later);
+println(xs, 3);
+println(cube(3));
+println(abs(-5));
+string:int seen;
+seen["bee"] += 2;
+println(seen["bee"]);
@@ -0,0 +1,4 @@
+// Indices must be numbers
+int~ a[3];
+string s = "x";
+println(a[s]);
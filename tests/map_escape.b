@@ -0,0 +1,8 @@
+// A copy of a map cannot outlive the block that frees it
+int:int base;
+int:int outer = base;
+int k = 1;
+if (k > 0) {
+    int:int m;
+    outer = m;
+}
@@ -0,0 +1,7 @@
+// A map is freed at the end of its block and goes out of scope there
+int k = 1;
+if (k > 0) {
+    int:int m;
+    m[1] = 2;
+}
+println(m[1]);
@@ -0,0 +1,51 @@
+// Maps count without setup, grow past many groups and free their keys
+string:int votes;
+votes["ann"] += 1;
+votes["bob"] += 1;
+votes["ann"] += 1;
+println(votes["ann"]);
+println(votes["bob"]);
+println(votes["cy"]);
+println(len(votes));
+println(contains(votes, "cy"));
+println(contains(votes, "bob"));
+
+int:int squares;
+int i = -500;
+while (i < 500) {
+    squares[i] = i * i;
+    i += 1;
+}
+println(len(squares));
+println(squares[-499]);
+println(squares[499]);
+int keys = 0;
+for k in squares {
+    keys += k;
+}
+println(keys);
+
+int:double half;
+half[3] = 1.5;
+half[3] += 1.0;
+println(half[3]);
+
+int distinct(int n) {
+    int:bool seen;
+    int j = 0;
+    while (j < n) {
+        seen[j - j / 7 * 7] = true;
+        j += 1;
+    }
+    return len(seen);
+}
+println(distinct(100));
+
+int round = 0;
+while (round < 2) {
+    string:string names;
+    names["k"] = "v";
+    string:string same = names;
+    println(same["k"]);
+    round += 1;
+}
@@ -0,0 +1,28 @@
+// Narrow integers and float wrap, convert and index like their C counterparts
+u8 byte = 250;
+byte += 10;
+println(byte);
+i8 small = 127;
+small += 1;
+println(small);
+u16 wide = 65535;
+println(wide);
+i32 mid = -100000;
+println(mid);
+float f = 0.25;
+double d = f * 2;
+println(d);
+
+u8~ pixels[300];
+u8 at = 200;
+pixels[at] = 9;
+println(pixels[at]);
+i16 pos = 299;
+pixels[pos] = 255;
+println(pixels[pos]);
+
+float~ weights = [0.5, 1.5, 2.5];
+u8 count = 3;
+println(weights, count);
+i32 k = 2;
+println(weights[k]);
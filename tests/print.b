@@ -0,0 +1,20 @@
+// Typed print builtins pick a writer from the static type of their argument
+println(42);
+println(-7);
+u32 big = 4000000000;
+println(big);
+println(2.5);
+println(true);
+println("text");
+print("no newline, ");
+println("then one");
+println([1, 2, 3]);
+println([1.5, 2.5]);
+println(["a", "b"]);
+int~ xs = [5, 6, 7, 8];
+println(xs, 2);
+u8 count = 3;
+println(xs, count);
+i16~ small = [-1, 2, -3];
+println(small, 3);
+println();
@@ -0,0 +1,3 @@
+// A scalar print takes exactly one value
+int x = 1;
+println(x, 2);
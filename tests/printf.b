@@ -0,0 +1,15 @@
+// Constant formats are split into typed writes, others go through bee_printf,
+// both return the number of bytes written
+int n = printf("%d + %d = %d\n", 2, 3, 5);
+println(n);
+n = printf("%s has %.2f%%\n", "pi", 3.14159);
+println(n);
+n = printf("%c%c%c\n", 98, 101, 101);
+println(n);
+n = printf("%5d|%-3s|\n", 42, "x");
+println(n);
+float f = 1.5;
+i8 neg = -3;
+printf("%g %d\n", f, neg);
+string format = "%d apples\n";
+printf(format, 12);
@@ -0,0 +1,3 @@
+// Views have no printf conversion, print writes them
+view v = mmap_file("scores.csv");
+printf("%s\n", v);
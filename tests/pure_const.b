@@ -0,0 +1,4 @@
+// @const implies @pure, and LLVM rejects the two together
+@pure @const int square(int x) {
+    return x * x;
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Runs every tests/*.b with bee-run. A test passes when its output matches the
+# .out file next to it or, for a program that must not compile, when the
+# error in its .err file is reported. Then builds incremental/program.b twice
+# with bee and links it against libbee-rt.a with $CXX.
+cd "$(dirname "$0")"
+tests=$(pwd)
+failed=0
+
+for program in *.b; do
+	name=${program%.b}
+	output=$(../bee-run "$program" 2>&1)
+	if [ -f "$name.err" ]; then
+		echo "$output" | grep -qF -- "$(cat "$name.err")"
+	else
+		[ "$output" = "$(cat "$name.out")" ]
+	fi
+	if [ $? -eq 0 ]; then
+		echo "PASS $name"
+	else
+		echo "FAIL $name"
+		echo "$output" | head -n 20
+		failed=$((failed + 1))
+	fi
+done
+
+# Moving every line down must not rebuild anything, changing a function must
+build=$(mktemp -d)
+cp incremental/program.b "$build"
+(
+	cd "$build" &&
+	"$tests/../bee" build --incremental program.b > /dev/null &&
+	{ echo; cat program.b; } > moved.b && mv moved.b program.b &&
+	"$tests/../bee" build --incremental program.b | grep -q "(0 of" &&
+	${CXX:-clang++} out.o "$tests/../libbee-rt.a" -lpthread -o program &&
+	[ "$(./program)" = "$(cat "$tests/incremental/program.out")" ] &&
+	sed 's/x \* x;/x * x * 1;/' program.b > changed.b && mv changed.b program.b &&
+	! "$tests/../bee" build --incremental program.b | grep -q "(0 of"
+)
+if [ $? -eq 0 ]; then
+	echo "PASS incremental"
+else
+	echo "FAIL incremental"
+	failed=$((failed + 1))
+fi
+rm -rf "$build"
+
+if [ $failed -gt 0 ]; then
+	echo "$failed failed"
+	exit 1
+fi
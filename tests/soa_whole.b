@@ -0,0 +1,6 @@
+// @soa columns are separate arrays, so the array cannot be used as a whole
+struct Point {
+    double x;
+}
+Point~ ps[4] @soa;
+Point~ copy = ps;
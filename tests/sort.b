@@ -0,0 +1,73 @@
+// Sorting and searching every element type, small arrays through the
+// comparison sorts and big ones through the radix and parallel sorts
+int~ xs = [5, 3, 9, 1, 7, 3, 8];
+sort(xs, 7);
+println(xs, 7);
+println(binary_search(xs, 7, 7));
+println(binary_search(xs, 7, 4));
+
+double~ ds = [2.5, -1.0, 9.0, 0.5, 3.0];
+println(partition(ds, 5, 2.6));
+println(nth_element(ds, 5, 2));
+println(nth_element(ds, 5, 4));
+
+string~ names = ["pear", "apple", "fig", "banana"];
+sort(names, 4);
+println(names, 4);
+println(binary_search(names, 4, "fig"));
+
+i16~ small = [300, -5, 12];
+sort(small, 3);
+println(small, 3);
+
+bool later(int a, int b) {
+    return a > b;
+}
+sort_by(xs, 7, later);
+println(xs, 7);
+
+int unsorted(int~ data, int n) {
+    int bad = 0;
+    int i = 1;
+    while (i < n) {
+        if (data[i] < data[i - 1]) {
+            bad += 1;
+        }
+        i += 1;
+    }
+    return bad;
+}
+
+int n = 200000;
+int~ big[n];
+int i = 0;
+while (i < n) {
+    big[i] = (i * 7919) - (i * 7919) / 100003 * 100003 - 50000;
+    i += 1;
+}
+sort(big, n);
+println(unsorted(big, n));
+println(big[0]);
+println(big[n - 1]);
+
+int m = 5000;
+int~ medium[m];
+i = 0;
+while (i < m) {
+    medium[i] = m - i;
+    i += 1;
+}
+sort(medium, m);
+println(unsorted(medium, m));
+println(medium[0]);
+
+bool before(int a, int b) {
+    return a < b;
+}
+i = 0;
+while (i < m) {
+    medium[i] = (i * 31) - (i * 31) / 1009 * 1009;
+    i += 1;
+}
+sort_by(medium, m, before);
+println(unsorted(medium, m));
@@ -0,0 +1,56 @@
+// Structs, sized arrays and both array layouts
+struct Point {
+    double x;
+    double y;
+    int id;
+}
+
+Point p;
+p.x = 1.5;
+p.y = -2.0;
+p.id = 7;
+println(p.x + p.y);
+println(p.id);
+
+int n = 100;
+Point~ aos[n];
+Point~ soa[n] @soa;
+int i = 0;
+while (i < n) {
+    aos[i].x = i;
+    soa[i].x = i;
+    soa[i].id = i * 2;
+    i += 1;
+}
+double total = 0.0;
+int ids = 0;
+i = 0;
+while (i < n) {
+    total += aos[i].x + soa[i].x;
+    ids += soa[i].id;
+    i += 1;
+}
+println(total);
+println(ids);
+
+int sum(int count) {
+    int~ squares[count];
+    int k = 0;
+    int t = 0;
+    while (k < count) {
+        squares[k] = k * k;
+        t += squares[k];
+        k += 1;
+    }
+    return t;
+}
+println(sum(10));
+
+int round = 0;
+while (round < 3) {
+    int~ fresh[4];
+    fresh[round] += round + 1;
+    int~ alias = fresh;
+    println(alias, 4);
+    round += 1;
+}
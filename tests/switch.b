@@ -0,0 +1,40 @@
+// Integer switches jump straight to their case, string switches hash once
+string name(int op) {
+    string result = "other";
+    switch (op) {
+        case 0, 1: result = "push";
+        case 2: result = "pop";
+        case -1: result = "halt";
+    }
+    return result;
+}
+println(name(0));
+println(name(1));
+println(name(2));
+println(name(-1));
+println(name(9));
+
+int score(string word) {
+    int points = 0;
+    switch (word) {
+        case "bee": points = 3;
+        case "hive": points = 4;
+        case "": points = -1;
+        default: points = 1;
+    }
+    return points;
+}
+println(score("bee"));
+println(score("hive"));
+println(score(""));
+println(score("wasp"));
+
+u8 level = 255;
+switch (level) {
+    case 255: println("full");
+    case 0: println("empty");
+}
+string any = "x";
+switch (any) {
+    default: println("only default");
+}
@@ -0,0 +1,6 @@
+// Cases never repeat
+int n = 1;
+switch (n) {
+    case 1: println(1);
+    case 2, 1: println(2);
+}
@@ -0,0 +1,5 @@
+// A case the switch type cannot hold is an error, not a truncated match
+u8 b = 0;
+switch (b) {
+    case 256: println("zero?");
+}
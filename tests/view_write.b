@@ -0,0 +1,3 @@
+// Views point into memory BEE does not own, so they cannot be written
+view v = mmap_file("scores.csv");
+v[0] = 65;
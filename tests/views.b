@@ -0,0 +1,27 @@
+// Memory-mapped views split into lines and fields without copying,
+// and parsed as numbers in place
+view rest = mmap_file("scores.csv");
+view line;
+view field;
+next_line(rest, line);
+println(line);
+println(line[0]);
+int count = 0;
+double score = 0.0;
+while (next_line(rest, line)) {
+    if (len(line) > 0) {
+        next_field(line, field, ",");
+        print(field);
+        next_field(line, field, ",");
+        int n = parse_int(field);
+        count += n;
+        printf(" %d ", n);
+        double s = parse_double(line);
+        score += s;
+        println(s);
+    }
+}
+println(count);
+println(score);
+unmap(rest);
+println(len(rest));